@@ -14,58 +14,648 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <cstdio>
+#include <functional>
 #include <unordered_map>
+#include <new>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Lists smaller than this are sorted with std::sort, the radix passes do not pay off
+const size_t RADIX_SORT_THRESHOLD = 256;
+// Largest key range sorted with a single counting pass, wider ranges use LSD radix passes
+const uint64_t COUNTING_SORT_MAX_RANGE = 1 << 22;
+// The counting pass is only used when the key range is at most this many times the number of values
+const uint64_t COUNTING_SORT_RANGE_FACTOR = 4;
+// Bits consumed by every LSD radix pass
+const int RADIX_BITS = 8;
+
+/**
+ * @brief Sort a list of location IDs in ascending order, in place.
+ *        The key width is taken from the observed min/max: ranges that are narrow and dense (the usual
+ *        5-6 digit IDs in a full list) are sorted with one counting pass, the others with as many LSD
+ *        radix passes as needed.
+ * @param[in,out] values: The list of location IDs to sort.
+ */
+void radixSortLocationIds(std::vector<int>& values) {
+  if (values.size() < RADIX_SORT_THRESHOLD) {
+    std::sort(values.begin(), values.end());
+    return;
+  }
+
+  // Keys are stored as offsets from the minimum value, so negative IDs are handled as well
+  auto [minIt, maxIt] = std::minmax_element(values.begin(), values.end());
+  const int64_t minValue = *minIt;
+  const uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(*maxIt) - minValue);
+
+  if (range < COUNTING_SORT_MAX_RANGE && range <= COUNTING_SORT_RANGE_FACTOR * values.size()) {
+    // Counting sort: count every key and rewrite the list in place
+    std::vector<uint32_t> counts(range + 1, 0);
+    for (int value : values) { counts[value - minValue]++; }
+    size_t position = 0;
+    for (uint64_t key = 0; key <= range; ++key) {
+      std::fill_n(values.begin() + position, counts[key], static_cast<int>(minValue + key));
+      position += counts[key];
+    }
+    return;
+  }
+
+  // LSD radix sort: only as many passes as the key width of the observed range requires
+  int keyBits = 0;
+  while (keyBits < 64 && (range >> keyBits) != 0) { keyBits += RADIX_BITS; }
+
+  const size_t buckets = size_t(1) << RADIX_BITS;
+  std::vector<int> buffer(values.size());
+  std::vector<size_t> offsets(buckets);
+  for (int shift = 0; shift < keyBits; shift += RADIX_BITS) {
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (int value : values) { offsets[((value - minValue) >> shift) & (buckets - 1)]++; }
+
+    // Turn the bucket counts into starting offsets
+    size_t sum = 0;
+    for (size_t& offset : offsets) {
+      size_t count = offset;
+      offset = sum;
+      sum += count;
+    }
+
+    for (int value : values) { buffer[offsets[((value - minValue) >> shift) & (buckets - 1)]++] = value; }
+    values.swap(buffer);
+  }
+}
 
 /**
- * @brief Calculate the total distance between two lists of integers.
- * @param[in] left: The list of integers on the left.
- * @param[in] right: The list of integers on the right.
+ * @brief Calculate the total distance between two sorted lists of integers.
+ *        The absolute differences are summed as a vectorized 64-bit reduction.
+ * @param[in] sortedLeft: The list of integers on the left, in ascending order.
+ * @param[in] sortedRight: The list of integers on the right, in ascending order.
  * @return The total distance between the two lists.
  */
-int calculateTotalDistance(const std::vector<int>& left, const std::vector<int>& right) {
-  // Create sorted copies of the two lists
-  std::vector<int> sortedLeft = left;
-  std::vector<int> sortedRight = right;
+long long calculateTotalDistance(const std::vector<int>& sortedLeft, const std::vector<int>& sortedRight) {
+  const size_t size = std::min(sortedLeft.size(), sortedRight.size());
+  size_t i = 0;
+  long long totalDistance = 0;
 
-  // Sort the two lists in ascending order
-  std::sort(sortedLeft.begin(), sortedLeft.end());
-  std::sort(sortedRight.begin(), sortedRight.end());
+#ifdef __AVX2__
+  // Widen 4 pairs at a time to 64 bits, so the differences can never overflow, and keep 4 partial sums
+  __m256i sums = _mm256_setzero_si256();
+  for (; i + 4 <= size; i += 4) {
+    __m256i left = _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&sortedLeft[i])));
+    __m256i right = _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&sortedRight[i])));
+    __m256i diff = _mm256_sub_epi64(left, right);
+    // Absolute value: (diff ^ sign) - sign, AVX2 has no 64-bit abs instruction
+    __m256i sign = _mm256_cmpgt_epi64(_mm256_setzero_si256(), diff);
+    sums = _mm256_add_epi64(sums, _mm256_sub_epi64(_mm256_xor_si256(diff, sign), sign));
+  }
 
-  // Calculate the total distance
-  int totalDistance = 0;
-  for (size_t i = 0; i < sortedLeft.size(); ++i) {
-    // Add the absolute difference between each pair of elements
-    totalDistance += std::abs(sortedLeft[i] - sortedRight[i]);
+  alignas(32) long long partialSums[4];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(partialSums), sums);
+  totalDistance = partialSums[0] + partialSums[1] + partialSums[2] + partialSums[3];
+#endif
+
+  // Remaining pairs (or every pair without AVX2, a branch-free loop the compiler can vectorize)
+  for (; i < size; ++i) {
+    totalDistance += std::abs(static_cast<long long>(sortedLeft[i]) - sortedRight[i]);
   }
 
   return totalDistance;
 }
 
 /**
- * @brief Calculate the similarity score between two lists of integers.
- * @param[in] left: The list of integers on the left.
- * @param[in] right: The list of integers on the right.
+ * @brief Calculate the similarity score between two sorted lists of integers.
+ *        Equal values of both lists are found with a two-pointer merge-join.
+ * @param[in] sortedLeft: The list of integers on the left, in ascending order.
+ * @param[in] sortedRight: The list of integers on the right, in ascending order.
  * @return The similarity score between the two lists.
  */
-int calculateSimilarityScore(const std::vector<int>& left, const std::vector<int>& right) {
-  // Count occurrences of each number in the right list
-  std::unordered_map<int, int> rightCount;
-  for (int num : right) { rightCount[num]++; }
-
-  // Calculate the similarity score by multiplying each number in the left list by its count in the right list
-  int similarityScore = 0;
-  for (int num : left) { similarityScore += num * rightCount[num]; }
+long long calculateSimilarityScore(const std::vector<int>& sortedLeft, const std::vector<int>& sortedRight) {
+  long long similarityScore = 0;
+  size_t i = 0, j = 0;
+  while (i < sortedLeft.size() && j < sortedRight.size()) {
+    if (sortedLeft[i] < sortedRight[j]) { ++i; }
+    else if (sortedRight[j] < sortedLeft[i]) { ++j; }
+    else {
+      // Every number of the left run is multiplied by the length of the right run
+      const int value = sortedLeft[i];
+      size_t leftStart = i, rightStart = j;
+      while (i < sortedLeft.size() && sortedLeft[i] == value) { ++i; }
+      while (j < sortedRight.size() && sortedRight[j] == value) { ++j; }
+      similarityScore += static_cast<long long>(value) * (i - leftStart) * (j - rightStart);
+    }
+  }
 
   return similarityScore;
 }
 
+// Most runs merged at once: bounds the open merge blocks, more runs are merged in several passes
+const size_t MAX_MERGE_FAN_IN = 64;
+// Largest run buffer of the external mode, in pairs (two 16 GiB buffers of location IDs)
+const long long MAX_BUFFER_PAIRS = 1LL << 32;
+// First capacity of the run buffers, they then double until they reach the buffer size
+const size_t MIN_RUN_CAPACITY = 1 << 12;
+
+/**
+ * @brief Sorted runs of location IDs stored one after the other in a single temporary file,
+ *        so the number of open files does not grow with the number of runs.
+ */
+struct RunFile {
+  struct Run {
+    size_t begin = 0, length = 0; // In values, from the start of the file
+  };
+
+  std::FILE* file = nullptr;
+  std::vector<Run> runs;
+  size_t size = 0;
+
+  // Write values at the end of the file, false if they could not be written
+  bool write(const int* values, size_t length) {
+    if (!file && !(file = std::tmpfile())) { return false; }
+    if (std::fseek(file, 0, SEEK_END) != 0 || std::fwrite(values, sizeof(int), length, file) != length) { return false; }
+    size += length;
+    return true;
+  }
+
+  // Append a sorted run at the end of the file, false if it could not be written
+  bool append(const int* values, size_t length) {
+    const size_t begin = size;
+    if (!write(values, length)) { return false; }
+    runs.push_back({begin, length});
+    return true;
+  }
+
+  void close() {
+    if (file) { std::fclose(file); }
+    file = nullptr;
+    runs.clear();
+    size = 0;
+  }
+};
+
+/**
+ * @brief Merges sorted runs of a run file into one ascending stream.
+ *        Every run is read through its own block, so memory stays bounded by the block sizes.
+ */
+class SortedRunMerger {
+ public:
+  SortedRunMerger(const RunFile& runFile, size_t firstRun, size_t runCount, size_t blockSize)
+      : file(runFile.file), blocks(runCount) {
+    for (size_t run = 0; run < runCount; ++run) {
+      blocks[run].next = runFile.runs[firstRun + run].begin;
+      blocks[run].remaining = runFile.runs[firstRun + run].length;
+      blocks[run].values.resize(std::min(blockSize, blocks[run].remaining));
+      if (refill(run)) { heap.push({blocks[run].values[0], run}); }
+    }
+  }
+
+  // Get the next smallest location ID of all the runs, false once every run is exhausted
+  bool next(int& value) {
+    if (heap.empty()) { return false; }
+
+    auto [smallest, run] = heap.top();
+    heap.pop();
+    value = smallest;
+
+    RunBlock& block = blocks[run];
+    if (++block.position < block.size || refill(run)) { heap.push({block.values[block.position], run}); }
+    return true;
+  }
+
+ private:
+  struct RunBlock {
+    std::vector<int> values;
+    size_t position = 0, size = 0;
+    size_t next = 0, remaining = 0; // Next value of the run in the file, and how many are left
+  };
+
+  std::FILE* file;
+  std::vector<RunBlock> blocks;
+  std::priority_queue<std::pair<int, size_t>, std::vector<std::pair<int, size_t>>, std::greater<>> heap;
+
+  // Read the next block of a run, false if the run has no values left
+  bool refill(size_t run) {
+    RunBlock& block = blocks[run];
+    block.position = 0;
+    block.size = 0;
+    if (block.remaining == 0 || std::fseek(file, static_cast<long>(block.next * sizeof(int)), SEEK_SET) != 0) { return false; }
+    block.size = std::fread(block.values.data(), sizeof(int), std::min(block.values.size(), block.remaining), file);
+    block.next += block.size;
+    block.remaining -= block.size;
+    return block.size > 0;
+  }
+};
+
+/**
+ * @brief Sort a buffer of location IDs and append it as a new run of a run file.
+ * @param[in,out] buffer: The location IDs of the run, emptied after being written.
+ * @param[in,out] runFile: The run file the run is appended to.
+ * @return True if the run was written, false otherwise.
+ */
+bool spillSortedRun(std::vector<int>& buffer, RunFile& runFile) {
+  radixSortLocationIds(buffer);
+  bool written = runFile.append(buffer.data(), buffer.size());
+  buffer.clear();
+  return written;
+}
+
+/**
+ * @brief Merge the runs of a run file in passes of at most MAX_MERGE_FAN_IN runs, until no more than
+ *        MAX_MERGE_FAN_IN are left. Every pass writes a new file and closes the previous one.
+ * @param[in,out] runFile: The run file to reduce.
+ * @param[in] bufferValues: The values the merge blocks and the output block may hold.
+ * @return True if the runs were merged, false otherwise.
+ */
+bool reduceSortedRuns(RunFile& runFile, size_t bufferValues) {
+  const size_t blockSize = std::max<size_t>(1, bufferValues / (MAX_MERGE_FAN_IN + 1));
+  std::vector<int> output;
+
+  while (runFile.runs.size() > MAX_MERGE_FAN_IN) {
+    // Only reached when the runs hold more values than the budget, the output block is then allocated once
+    output.reserve(blockSize);
+    RunFile merged;
+    for (size_t first = 0; first < runFile.runs.size(); first += MAX_MERGE_FAN_IN) {
+      const size_t count = std::min(MAX_MERGE_FAN_IN, runFile.runs.size() - first);
+      SortedRunMerger merger(runFile, first, count, blockSize);
+      const size_t runBegin = merged.size;
+
+      // Write the merged run block by block, then record it as a single run
+      int value;
+      bool written = true;
+      while (written && merger.next(value)) {
+        output.push_back(value);
+        if (output.size() == blockSize) {
+          written = merged.write(output.data(), output.size());
+          output.clear();
+        }
+      }
+      if (!written || !merged.write(output.data(), output.size())) {
+        merged.close();
+        return false;
+      }
+      output.clear();
+      merged.runs.push_back({runBegin, merged.size - runBegin});
+    }
+    runFile.close();
+    runFile = merged;
+  }
+  return true;
+}
+
+/**
+ * @brief Calculate the total distance and similarity score of two lists that may not fit in memory.
+ *        The input is cut into runs of at most bufferPairs pairs, each run is sorted and spilled to
+ *        one temporary file per list, the runs are merged in passes down to MAX_MERGE_FAN_IN, and the
+ *        left and right runs are then k-way merged in lockstep.
+ * @param[in] filename: The name of the input file.
+ * @param[in] bufferPairs: The maximum number of pairs held in memory at once.
+ * @param[out] totalDistance: The total distance between the two lists.
+ * @param[out] similarityScore: The similarity score between the two lists.
+ * @return True if the scores were calculated, false otherwise.
+ */
+bool calculateExternalScores(const std::string& filename, size_t bufferPairs, long long& totalDistance, long long& similarityScore) {
+  std::ifstream inputFile(filename);
+  if (!inputFile) {
+    std::cerr << "Error: Could not open file " << filename << std::endl;
+    return false;
+  }
+
+  // Split the input into sorted runs of at most bufferPairs pairs
+  RunFile leftRuns, rightRuns;
+  std::vector<int> leftBuffer, rightBuffer;
+
+  // The buffers grow with the input up to bufferPairs, a large budget is only a limit
+  bool spilled = true;
+  int leftValue, rightValue;
+  try {
+    while (spilled && inputFile >> leftValue >> rightValue) {
+      if (leftBuffer.size() == leftBuffer.capacity()) {
+        const size_t capacity = std::min(bufferPairs, std::max<size_t>(MIN_RUN_CAPACITY, 2 * leftBuffer.capacity()));
+        leftBuffer.reserve(capacity);
+        rightBuffer.reserve(capacity);
+      }
+      leftBuffer.push_back(leftValue);
+      rightBuffer.push_back(rightValue);
+      if (leftBuffer.size() == bufferPairs) {
+        spilled = spillSortedRun(leftBuffer, leftRuns) && spillSortedRun(rightBuffer, rightRuns);
+      }
+    }
+    if (spilled && !leftBuffer.empty()) {
+      spilled = spillSortedRun(leftBuffer, leftRuns) && spillSortedRun(rightBuffer, rightRuns);
+    }
+  } catch (const std::bad_alloc&) {
+    std::cerr << "Error: Could not allocate a buffer of " << bufferPairs << " pairs." << std::endl;
+    leftRuns.close();
+    rightRuns.close();
+    return false;
+  }
+  inputFile.close();
+
+  // Release the run buffers before merging, the merge blocks share the same memory budget of 2 * bufferPairs values
+  std::vector<int>().swap(leftBuffer);
+  std::vector<int>().swap(rightBuffer);
+
+  // Bring both sides down to a bounded number of runs, one side at a time
+  spilled = spilled && reduceSortedRuns(leftRuns, 2 * bufferPairs) && reduceSortedRuns(rightRuns, 2 * bufferPairs);
+
+  if (spilled) {
+    // Both sides are merged at once, each with half of the budget
+    const size_t blockSize = std::max<size_t>(1, bufferPairs / std::max<size_t>(1, leftRuns.runs.size()));
+
+    // Phase 1: Pair the i-th smallest values of both lists by merging the runs in lockstep
+    totalDistance = 0;
+    {
+      SortedRunMerger leftDistance(leftRuns, 0, leftRuns.runs.size(), blockSize);
+      SortedRunMerger rightDistance(rightRuns, 0, rightRuns.runs.size(), blockSize);
+      while (leftDistance.next(leftValue) && rightDistance.next(rightValue)) {
+        totalDistance += std::abs(static_cast<long long>(leftValue) - rightValue);
+      }
+    }
+
+    // Phase 2: Merge-join the equal values of both lists, the phase 1 blocks being released
+    similarityScore = 0;
+    SortedRunMerger leftSimilarity(leftRuns, 0, leftRuns.runs.size(), blockSize);
+    SortedRunMerger rightSimilarity(rightRuns, 0, rightRuns.runs.size(), blockSize);
+    bool hasLeft = leftSimilarity.next(leftValue), hasRight = rightSimilarity.next(rightValue);
+    while (hasLeft && hasRight) {
+      if (leftValue < rightValue) { hasLeft = leftSimilarity.next(leftValue); }
+      else if (rightValue < leftValue) { hasRight = rightSimilarity.next(rightValue); }
+      else {
+        // Count the run of the same value on both sides
+        const int value = leftValue;
+        long long leftCount = 0, rightCount = 0;
+        while (hasLeft && leftValue == value) { leftCount++; hasLeft = leftSimilarity.next(leftValue); }
+        while (hasRight && rightValue == value) { rightCount++; hasRight = rightSimilarity.next(rightValue); }
+        similarityScore += value * leftCount * rightCount;
+      }
+    }
+  } else {
+    std::cerr << "Error: Could not write the sorted runs to temporary files." << std::endl;
+  }
+
+  leftRuns.close();
+  rightRuns.close();
+  return spilled;
+}
+
+// Default location ID domain of the incremental mode (5-6 digit IDs), widened to fit the IDs that are inserted
+const int MIN_LOCATION_ID = 0;
+const int MAX_LOCATION_ID = 999999;
+// Widest location ID domain of the incremental mode, one cell of D per ID
+const int64_t MAX_DOMAIN_CELLS = int64_t(1) << 26;
+
+/**
+ * @brief Keeps the total distance and similarity score of two lists up to date while location ID pairs
+ *        are inserted and removed, so the current values can be read at any point without a re-sort.
+ *        The total distance of two sorted lists equals the sum of |D(x)| over every unit interval
+ *        [x, x + 1) of the ID domain, where D(x) = #{left <= x} - #{right <= x}. Inserting a left (right)
+ *        ID adds +1 (-1) to D on a suffix of the domain, so D is kept in sqrt-sized blocks with a lazy
+ *        offset and a histogram of their values: the distance change of a whole block is then known in O(1).
+ *        The similarity score is kept from the counts of every ID on each side.
+ */
+class IncrementalLocationLists {
+ public:
+  // Seed the lists with the initial pairs in one pass: the counts and the similarity score are
+  // gathered first, then D is built once, so only the later operations pay the per-update cost
+  IncrementalLocationLists(const std::vector<int>& leftList, const std::vector<int>& rightList, int minId, int maxId)
+      : pairs(leftList.size()) {
+    for (int id : leftList) { leftCounts[id]++; }
+    for (int id : rightList) { rightCounts[id]++; }
+    for (const auto& [id, count] : leftCounts) {
+      auto it = rightCounts.find(id);
+      if (it != rightCounts.end()) { similarityScore += static_cast<long long>(id) * count * it->second; }
+    }
+    rebuildDomain(minId, maxId);
+  }
+
+  // Check if a location ID fits in the domain of the lists
+  bool inDomain(int id) const { return id >= minId && id <= maxId; }
+
+  // Widen the domain to fit a location ID, at least doubling it so that rebuilds stay rare.
+  // False if the domain would grow past MAX_DOMAIN_CELLS, the lists being left unchanged
+  bool growDomain(int id) {
+    if (inDomain(id)) { return true; }
+    const int64_t width = static_cast<int64_t>(maxId) - minId;
+    int64_t newMin = minId, newMax = maxId;
+    if (id < minId) { newMin = std::min<int64_t>(id, static_cast<int64_t>(minId) - width); }
+    else { newMax = std::max<int64_t>(id, static_cast<int64_t>(maxId) + width); }
+    newMin = std::max<int64_t>(newMin, INT32_MIN);
+    newMax = std::min<int64_t>(newMax, INT32_MAX);
+
+    // Doubling may overshoot the limit while the ID itself still fits
+    if (newMax - newMin > MAX_DOMAIN_CELLS) {
+      if (id < minId) { newMin = std::max<int64_t>(newMin, newMax - MAX_DOMAIN_CELLS); }
+      else { newMax = std::min<int64_t>(newMax, newMin + MAX_DOMAIN_CELLS); }
+      if (id < newMin || id > newMax) { return false; }
+    }
+    rebuildDomain(newMin, newMax);
+    return true;
+  }
+
+  // Insert a pair of location IDs, one in each list
+  void insertPair(int left, int right) {
+    similarityScore += static_cast<long long>(left) * rightCounts[left];
+    leftCounts[left]++;
+    similarityScore += static_cast<long long>(right) * leftCounts[right];
+    rightCounts[right]++;
+
+    addToSuffix(left, 1);
+    addToSuffix(right, -1);
+    pairs++;
+  }
+
+  // Remove a pair of location IDs, false if either ID is not in its list
+  bool removePair(int left, int right) {
+    auto leftIt = leftCounts.find(left);
+    auto rightIt = rightCounts.find(right);
+    if (leftIt == leftCounts.end() || leftIt->second == 0 || rightIt == rightCounts.end() || rightIt->second == 0) {
+      return false;
+    }
+
+    leftIt->second--;
+    similarityScore -= static_cast<long long>(left) * rightCounts[left];
+    rightIt->second--;
+    similarityScore -= static_cast<long long>(right) * leftCounts[right];
+
+    addToSuffix(left, -1);
+    addToSuffix(right, 1);
+    pairs--;
+    return true;
+  }
+
+  long long getTotalDistance() const { return totalDistance; }
+  long long getSimilarityScore() const { return similarityScore; }
+  size_t size() const { return pairs; }
+
+ private:
+  struct Block {
+    size_t begin, end;                       // Range of cells covered by the block
+    int offset = 0;                          // Lazy value added to every cell of the block
+    long long negatives = 0;                 // Number of cells whose value (with the offset) is negative
+    std::unordered_map<int, long long> histogram; // Number of cells per stored value (without the offset)
+  };
+
+  int minId, maxId;
+  size_t blockSize;
+  size_t pairs = 0;
+  long long totalDistance = 0, similarityScore = 0;
+  std::vector<int> cells; // D(x) of every unit interval, without the offset of its block
+  std::vector<Block> blocks;
+  std::unordered_map<int, long long> leftCounts, rightCounts;
+
+  // Rebuild D over a new domain from the counts of every ID, as prefix sums of the per-ID differences
+  void rebuildDomain(int newMin, int newMax) {
+    minId = newMin;
+    maxId = newMax;
+    const size_t cellCount = static_cast<size_t>(static_cast<int64_t>(maxId) - minId);
+    blockSize = std::max<size_t>(1, static_cast<size_t>(std::sqrt(static_cast<double>(cellCount))));
+
+    cells.assign(cellCount, 0);
+    for (const auto& [id, count] : leftCounts) {
+      if (static_cast<size_t>(static_cast<int64_t>(id) - minId) < cellCount) { cells[id - minId] += count; }
+    }
+    for (const auto& [id, count] : rightCounts) {
+      if (static_cast<size_t>(static_cast<int64_t>(id) - minId) < cellCount) { cells[id - minId] -= count; }
+    }
+    for (size_t cell = 1; cell < cellCount; ++cell) { cells[cell] += cells[cell - 1]; }
+
+    blocks.clear();
+    totalDistance = 0;
+    for (size_t begin = 0; begin < cellCount; begin += blockSize) {
+      Block block;
+      block.begin = begin;
+      block.end = std::min(cellCount, begin + blockSize);
+      for (size_t cell = block.begin; cell < block.end; ++cell) {
+        block.histogram[cells[cell]]++;
+        block.negatives += cells[cell] < 0;
+        totalDistance += std::abs(cells[cell]);
+      }
+      blocks.push_back(block);
+    }
+  }
+
+  // Add delta (+1 or -1) to D on every cell from the given location ID to the end of the domain
+  void addToSuffix(int id, int delta) {
+    size_t first = static_cast<size_t>(static_cast<int64_t>(id) - minId);
+    if (first >= cells.size()) { return; }
+
+    size_t blockIndex = first / blockSize;
+    // The first block may be covered only partially, update its cells one by one
+    Block& partial = blocks[blockIndex];
+    if (first != partial.begin) {
+      for (size_t cell = first; cell < partial.end; ++cell) { addToCell(partial, cell, delta); }
+      blockIndex++;
+    }
+
+    // The rest of the blocks are fully covered, the change of |D| follows from the histogram
+    for (; blockIndex < blocks.size(); ++blockIndex) {
+      Block& block = blocks[blockIndex];
+      const long long cellCount = block.end - block.begin;
+      if (delta > 0) {
+        // |v + 1| - |v| is +1 for v >= 0 and -1 for v < 0, and the cells at -1 stop being negative
+        totalDistance += cellCount - 2 * block.negatives;
+        block.negatives -= histogramCount(block, -1 - block.offset);
+      } else {
+        // |v - 1| - |v| is +1 for v <= 0 and -1 for v > 0, and the cells at 0 become negative
+        const long long zeros = histogramCount(block, -block.offset);
+        totalDistance += 2 * (block.negatives + zeros) - cellCount;
+        block.negatives += zeros;
+      }
+      block.offset += delta;
+    }
+  }
+
+  // Add delta to a single cell of a block
+  void addToCell(Block& block, size_t cell, int delta) {
+    const int oldValue = cells[cell] + block.offset;
+    const int newValue = oldValue + delta;
+    block.histogram[cells[cell]]--;
+    cells[cell] += delta;
+    block.histogram[cells[cell]]++;
+
+    totalDistance += std::abs(newValue) - std::abs(oldValue);
+    block.negatives += (newValue < 0) - (oldValue < 0);
+  }
+
+  // Number of cells of a block whose stored value is the given one
+  static long long histogramCount(const Block& block, int value) {
+    auto it = block.histogram.find(value);
+    return it == block.histogram.end() ? 0 : it->second;
+  }
+};
+
+/**
+ * @brief Apply a file of pair operations to the incremental lists.
+ *        Every line is "+ <left> <right>" to insert a pair, "- <left> <right>" to remove it,
+ *        or "?" to print the current total distance and similarity score.
+ * @param[in,out] lists: The incremental lists.
+ * @param[in] filename: The name of the operations file.
+ * @return True if the operations file was processed, false otherwise.
+ */
+bool applyPairOperations(IncrementalLocationLists& lists, const std::string& filename) {
+  std::ifstream operationsFile(filename);
+  if (!operationsFile) {
+    std::cerr << "Error: Could not open file " << filename << std::endl;
+    return false;
+  }
+
+  std::string operation;
+  while (operationsFile >> operation) {
+    if (operation == "?") {
+      std::cout << "The total distance is: " << lists.getTotalDistance() << std::endl;
+      std::cout << "The similarity score is: " << lists.getSimilarityScore() << std::endl;
+      continue;
+    }
+
+    int left, right;
+    if ((operation != "+" && operation != "-") || !(operationsFile >> left >> right)) {
+      std::cerr << "Error: Invalid operation '" << operation << "'." << std::endl;
+      return false;
+    }
+
+    if (operation == "+") {
+      // IDs outside the domain widen it, the metrics must stay exact for every later query
+      if (!lists.growDomain(left) || !lists.growDomain(right)) {
+        std::cerr << "Error: Pair " << left << " " << right << " does not fit in a location ID domain of at most "
+                  << MAX_DOMAIN_CELLS << " IDs." << std::endl;
+        return false;
+      }
+      lists.insertPair(left, right);
+    } else if (!lists.removePair(left, right)) {
+      std::cerr << "Warning: Skipping removal of missing pair " << left << " " << right << "." << std::endl;
+    }
+  }
+
+  operationsFile.close();
+  return true;
+}
+
 int main(int argc, char* argv[]) {
   // Check if the input file was provided
-  if (argc != 2) {
-    std::cerr << "Usage: " << argv[0] << " <input_file>" << std::endl;
+  const std::string mode = argc == 4 ? argv[2] : "";
+  if (argc != 2 && mode != "-external" && mode != "-incremental") {
+    std::cerr << "Usage: " << argv[0] << " <input_file> [-external <buffer_pairs> | -incremental <operations_file>]" << std::endl;
     return EXIT_FAILURE;
   }
 
+  // External-memory mode: the lists are sorted in bounded-size runs spilled to disk
+  if (mode == "-external") {
+    long long bufferPairs = std::atoll(argv[3]);
+    if (bufferPairs <= 0 || bufferPairs > MAX_BUFFER_PAIRS) {
+      std::cerr << "Error: The buffer size must be between 1 and " << MAX_BUFFER_PAIRS << " pairs." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    long long totalDistance, similarityScore;
+    if (!calculateExternalScores(argv[1], bufferPairs, totalDistance, similarityScore)) { return EXIT_FAILURE; }
+    std::cout << "The total distance is: " << totalDistance << std::endl;
+    std::cout << "The similarity score is: " << similarityScore << std::endl;
+    return EXIT_SUCCESS;
+  }
+
   std::ifstream inputFile(argv[1]);
   // Open the input file and check if it was opened successfully
   if (!inputFile) {
@@ -90,12 +680,35 @@ int main(int argc, char* argv[]) {
     return EXIT_FAILURE;
   }
 
+  // Incremental mode: the initial pairs seed the lists, then the operations file updates them
+  if (mode == "-incremental") {
+    int minId = MIN_LOCATION_ID, maxId = MAX_LOCATION_ID;
+    for (int id : leftList) { minId = std::min(minId, id); maxId = std::max(maxId, id); }
+    for (int id : rightList) { minId = std::min(minId, id); maxId = std::max(maxId, id); }
+
+    if (static_cast<int64_t>(maxId) - minId > MAX_DOMAIN_CELLS) {
+      std::cerr << "Error: The location IDs do not fit in a domain of at most " << MAX_DOMAIN_CELLS << " IDs." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    IncrementalLocationLists lists(leftList, rightList, minId, maxId);
+    if (!applyPairOperations(lists, argv[3])) { return EXIT_FAILURE; }
+
+    std::cout << "The total distance is: " << lists.getTotalDistance() << std::endl;
+    std::cout << "The similarity score is: " << lists.getSimilarityScore() << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  // Sort both lists once, in place, for both phases
+  radixSortLocationIds(leftList);
+  radixSortLocationIds(rightList);
+
   // Phase 1: Calculate the total distance between the two lists
-  int totalDistance = calculateTotalDistance(leftList, rightList);
+  long long totalDistance = calculateTotalDistance(leftList, rightList);
   std::cout << "The total distance is: " << totalDistance << std::endl;
 
   // Phase 2: Calculate the similarity score between the two lists
-  int similarityScore = calculateSimilarityScore(leftList, rightList);
+  long long similarityScore = calculateSimilarityScore(leftList, rightList);
   std::cout << "The similarity score is: " << similarityScore << std::endl;
 
   return EXIT_SUCCESS;
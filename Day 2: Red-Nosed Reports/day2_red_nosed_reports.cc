@@ -10,102 +10,713 @@
 
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <vector>
 #include <cmath>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <cctype>
+#include <cstdio>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Safety rules of a sensor class: the allowed step range between adjacent levels,
+ *        and how many bad levels the Problem Dampener may remove.
+ */
+struct SafetyPolicy {
+  int minStep = 1;     // Smallest allowed difference between adjacent levels
+  int maxStep = 3;     // Largest allowed difference between adjacent levels
+  int maxRemovals = 1; // Largest number of levels that may be removed
+};
+
+// Largest -removals accepted, far beyond any report length: the checks clamp it to the levels of each report anyway
+const long long MAX_REMOVALS = 1 << 20;
+
+/**
+ * @brief Check if the step between two adjacent levels is safe in a given direction.
+ * @param[in] from: The first level.
+ * @param[in] to: The next level.
+ * @param[in] direction: 1 if the levels must increase, -1 if they must decrease.
+ * @param[in] policy: The safety rules.
+ * @return True if the step is within [minStep, maxStep] in the given direction, false otherwise.
+ */
+inline bool isSafeStep(int from, int to, int direction, const SafetyPolicy& policy) {
+  int step = (to - from) * direction;
+  return step >= policy.minStep && step <= policy.maxStep;
+}
 
 /**
- * @brief Check if a report is safe.
+ * @brief Check if a report is safe without removing any level.
  * @param[in] levels: The list of levels in the report.
+ * @param[in] policy: The safety rules.
  * @return True if the report is safe, false otherwise.
  */
-bool isSafeReport(const std::vector<int>& levels) {
+bool isSafeReport(const std::vector<int>& levels, const SafetyPolicy& policy) {
   // A report must have at least two levels to be valid.
   if (levels.size() < 2) { return false; }
 
-  // The difference between the first two levels must be within [1, 3].
-  int diff = levels[1] - levels[0];
-  if (std::abs(diff) < 1 || std::abs(diff) > 3) { return false; }
-
-  bool increasing = diff > 0;
-  for (size_t i = 1; i < levels.size(); ++i) {
-    int currentDiff = levels[i] - levels[i - 1];
-    // Difference between adjacent levels is not within [1, 3].
-    if (std::abs(currentDiff) < 1 || std::abs(currentDiff) > 3) { return false; }
-    // The levels are not consistently increasing or decreasing.
-    if ((increasing && currentDiff < 0) || (!increasing && currentDiff > 0)) { return false; }
+  // The levels must be consistently increasing or decreasing, with every step within the range.
+  for (int direction : {1, -1}) {
+    size_t i = 1;
+    while (i < levels.size() && isSafeStep(levels[i - 1], levels[i], direction, policy)) { ++i; }
+    if (i == levels.size()) { return true; }
   }
 
-  // The report satisfies all conditions for safety.
-  return true; 
+  return false;
 }
 
 /**
  * @brief Check if a report can be made safe by removing one level.
+ *        Runs in a single pass per direction without allocating: only the first and the last unsafe steps
+ *        are tracked, which tells whether the prefix before and the suffix after a removed level are safe.
  * @param[in] levels: The list of levels in the report.
+ * @param[in] policy: The safety rules.
  * @return True if the report can be made safe, false otherwise.
  */
-bool canBeMadeSafe(const std::vector<int>& levels) {
-  for (size_t i = 0; i < levels.size(); ++i) {
-    // Create a new vector excluding the current level
-    std::vector<int> modifiedLevels;
-    for (size_t j = 0; j < levels.size(); ++j) {
-      if (j != i) { modifiedLevels.push_back(levels[j]); }
+bool canBeMadeSafe(const std::vector<int>& levels, const SafetyPolicy& policy) {
+  const size_t size = levels.size();
+  // Removing a level must still leave a valid report of at least two levels
+  if (size < 3) { return false; }
+
+  for (int direction : {1, -1}) {
+    // Step i joins the levels i - 1 and i
+    size_t firstUnsafe = size, lastUnsafe = 0;
+    for (size_t i = 1; i < size; ++i) {
+      if (!isSafeStep(levels[i - 1], levels[i], direction, policy)) {
+        if (firstUnsafe == size) { firstUnsafe = i; }
+        lastUnsafe = i;
+      }
     }
 
-    // Check if the modified report is safe
-    if (isSafeReport(modifiedLevels)) { return true; }
+    // Every step is safe, removing the first or the last level keeps it safe
+    if (firstUnsafe == size) { return true; }
+
+    // The removed level must be one of the two levels of the first unsafe step
+    for (size_t removed : {firstUnsafe - 1, firstUnsafe}) {
+      // The prefix before the removed level is safe by construction, the suffix after it must be safe too
+      if (lastUnsafe > removed + 1) { continue; }
+      // The levels around the removed one become adjacent
+      if (removed > 0 && removed + 1 < size && !isSafeStep(levels[removed - 1], levels[removed + 1], direction, policy)) { continue; }
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Check if a report can be made safe by removing at most maxRemovals levels.
+ *        Dynamic programming over the longest safe subsequence: for every level kept as the last one, the
+ *        fewest removals needed before it. Its predecessor is at most k + 1 positions back, k being
+ *        maxRemovals clamped to the size - 2 levels that can be removed at all, so the whole check is
+ *        O(n * k) instead of trying every combination of removals.
+ * @param[in] levels: The list of levels in the report.
+ * @param[in] policy: The safety rules.
+ * @return True if the report can be made safe, false otherwise.
+ */
+bool canBeMadeSafeWithRemovals(const std::vector<int>& levels, const SafetyPolicy& policy) {
+  const int size = levels.size();
+  // At least two levels must be kept, so more removals than size - 2 never help
+  const int allowedRemovals = std::min(policy.maxRemovals, size - 2);
+  if (allowedRemovals < 0) { return false; }
+
+  // Ring buffer with the fewest removals before each of the last allowedRemovals + 2 levels kept as the last one
+  const int window = allowedRemovals + 2;
+  const int unreachable = allowedRemovals + 1;
+  std::vector<int> removalsBefore(window);
+
+  for (int direction : {1, -1}) {
+    for (int i = 0; i < size; ++i) {
+      // Keep level i as the first one, removing every level before it
+      int best = i <= allowedRemovals ? i : unreachable;
+      // Or keep it right after an earlier kept level p, removing the levels in between
+      for (int p = std::max(0, i - allowedRemovals - 1); p < i; ++p) {
+        int removals = removalsBefore[p % window] + (i - 1 - p);
+        if (removals < best && isSafeStep(levels[p], levels[i], direction, policy)) { best = removals; }
+      }
+      removalsBefore[i % window] = best;
+
+      // Keep level i as the last one, removing every level after it
+      if (best + (size - 1 - i) <= allowedRemovals) { return true; }
+    }
   }
 
   return false;
 }
 
+/**
+ * @brief Check if a report is safe under a policy, removing at most maxRemovals levels.
+ *        Zero and one removals use the linear checks, larger tolerances the dynamic programming one.
+ * @param[in] levels: The list of levels in the report.
+ * @param[in] policy: The safety rules.
+ * @return True if the report is safe, false otherwise.
+ */
+bool isSafeUnderPolicy(const std::vector<int>& levels, const SafetyPolicy& policy) {
+  if (isSafeReport(levels, policy)) { return true; }
+  if (policy.maxRemovals == 0) { return false; }
+  if (policy.maxRemovals == 1) { return canBeMadeSafe(levels, policy); }
+  return canBeMadeSafeWithRemovals(levels, policy);
+}
+
+// Levels per report lane of the batched kernel, longer reports are checked by the scalar code
+const int LANE_WIDTH = 16;
+// Levels packed into a lane must fit this range, so their differences never overflow 16 bits
+const int LANE_MIN_LEVEL = -8192;
+const int LANE_MAX_LEVEL = 8191;
+// Number of reports classified per batch
+const size_t BATCH_SIZE = 256;
+// Smallest chunk of the input file handed to a worker thread
+const std::streamoff MIN_CHUNK_SIZE = 1 << 20;
+
+/**
+ * @brief A batch of short reports, each one padded to a lane of LANE_WIDTH 16-bit levels.
+ *        One extra lane at the end keeps the shifted loads of the last report in bounds.
+ */
+struct ReportBatch {
+  std::vector<int16_t> levels = std::vector<int16_t>((BATCH_SIZE + 1) * LANE_WIDTH, 0);
+  uint8_t sizes[BATCH_SIZE];
+  size_t count = 0;
+
+  // Pack a report into the next lane, false if it is too long or its levels are out of range
+  bool add(const std::vector<int>& report) {
+    if (report.size() > LANE_WIDTH) { return false; }
+    for (int level : report) {
+      if (level < LANE_MIN_LEVEL || level > LANE_MAX_LEVEL) { return false; }
+    }
+
+    std::copy(report.begin(), report.end(), levels.begin() + count * LANE_WIDTH);
+    sizes[count++] = report.size();
+    return true;
+  }
+
+  bool full() const { return count == BATCH_SIZE; }
+};
+
+/**
+ * @brief Compute, for a lane of levels and a gap g, which steps from level i to level i + g are safe
+ *        in each direction. Bit i of each mask belongs to the step starting at level i.
+ * @param[in] lane: The levels of the report, followed by at least LANE_WIDTH readable levels.
+ * @param[in] gap: The distance between the levels of every step.
+ * @param[in] policy: The safety rules.
+ * @param[out] increasing: The mask of the safe increasing steps.
+ * @param[out] decreasing: The mask of the safe decreasing steps.
+ */
+inline void computeStepMasks(const int16_t* lane, int gap, const SafetyPolicy& policy, uint32_t& increasing, uint32_t& decreasing) {
+  // Differences between lane levels stay within 16 bits, so the bounds can be clamped to that range
+  const int16_t minStep = std::min(policy.minStep, INT16_MAX - 1);
+  const int16_t maxStep = std::min(policy.maxStep, INT16_MAX - 1);
+
+#ifdef __AVX2__
+  // Differences of the 16 levels of the lane in a single register
+  __m256i levels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lane));
+  __m256i shifted = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lane + gap));
+  __m256i diff = _mm256_sub_epi16(shifted, levels);
+
+  // Range checks in both directions: minStep <= diff <= maxStep and -maxStep <= diff <= -minStep
+  __m256i up = _mm256_and_si256(_mm256_cmpgt_epi16(diff, _mm256_set1_epi16(minStep - 1)),
+                                _mm256_cmpgt_epi16(_mm256_set1_epi16(maxStep + 1), diff));
+  __m256i down = _mm256_and_si256(_mm256_cmpgt_epi16(diff, _mm256_set1_epi16(-maxStep - 1)),
+                                  _mm256_cmpgt_epi16(_mm256_set1_epi16(-minStep + 1), diff));
+
+  // Narrow both masks to bytes, per 128-bit half: [up 0-7, down 0-7, up 8-15, down 8-15]
+  uint32_t bits = _mm256_movemask_epi8(_mm256_packs_epi16(up, down));
+  increasing = (bits & 0xFF) | ((bits >> 8) & 0xFF00);
+  decreasing = ((bits >> 8) & 0xFF) | ((bits >> 16) & 0xFF00);
+#else
+  increasing = decreasing = 0;
+  for (int i = 0; i < LANE_WIDTH; ++i) {
+    int diff = lane[i + gap] - lane[i];
+    increasing |= uint32_t(diff >= minStep && diff <= maxStep) << i;
+    decreasing |= uint32_t(-diff >= minStep && -diff <= maxStep) << i;
+  }
+#endif
+}
+
+/**
+ * @brief Check if a report is safe from the masks of its safe steps in one direction.
+ *        Same dynamic programming as canBeMadeSafeWithRemovals, but every step check is a bit test.
+ * @param[in] masks: The safe step masks, masks[g - 1] for the steps of gap g.
+ * @param[in] size: The number of levels of the report.
+ * @param[in] maxRemovals: The largest number of levels that may be removed.
+ * @return True if the report is safe, false otherwise.
+ */
+bool isSafeFromStepMasks(const uint32_t* masks, int size, int maxRemovals) {
+  // At least two levels must be kept
+  const int allowedRemovals = std::min(maxRemovals, size - 2);
+  if (allowedRemovals < 0) { return false; }
+
+  // No removals: every adjacent step must be safe
+  const uint32_t adjacentSteps = (uint32_t(1) << (size - 1)) - 1;
+  if ((masks[0] & adjacentSteps) == adjacentSteps) { return true; }
+  if (allowedRemovals == 0) { return false; }
+
+  const int unreachable = allowedRemovals + 1;
+  int removalsBefore[LANE_WIDTH];
+  for (int i = 0; i < size; ++i) {
+    int best = i <= allowedRemovals ? i : unreachable;
+    for (int p = std::max(0, i - allowedRemovals - 1); p < i; ++p) {
+      int removals = removalsBefore[p] + (i - 1 - p);
+      if (removals < best && (masks[i - p - 1] >> p & 1)) { best = removals; }
+    }
+    removalsBefore[i] = best;
+    if (best + (size - 1 - i) <= allowedRemovals) { return true; }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Count the safe reports of a batch.
+ *        The step masks of every lane are computed in SIMD registers, the removals are then resolved on the masks.
+ * @param[in] batch: The batch of reports.
+ * @param[in] policy: The safety rules.
+ * @return The number of safe reports in the batch.
+ */
+int countSafeInBatch(const ReportBatch& batch, const SafetyPolicy& policy) {
+  // Only steps of gap up to maxRemovals + 1 can join two kept levels (clamped first, so it cannot overflow)
+  const int gaps = std::min(policy.maxRemovals, LANE_WIDTH - 2) + 1;
+  uint32_t increasing[LANE_WIDTH], decreasing[LANE_WIDTH];
+
+  int safeCount = 0;
+  for (size_t report = 0; report < batch.count; ++report) {
+    const int16_t* lane = batch.levels.data() + report * LANE_WIDTH;
+    const int size = batch.sizes[report];
+    for (int gap = 1; gap <= std::min(gaps, std::max(size - 1, 1)); ++gap) {
+      computeStepMasks(lane, gap, policy, increasing[gap - 1], decreasing[gap - 1]);
+    }
+
+    if (isSafeFromStepMasks(increasing, size, policy.maxRemovals) ||
+        isSafeFromStepMasks(decreasing, size, policy.maxRemovals)) { safeCount++; }
+  }
+
+  return safeCount;
+}
+
+/**
+ * @brief Parse the levels of a report.
+ * @param[in] begin: The first character of the report line.
+ * @param[in] end: One past the last character of the report line.
+ * @param[out] levels: The levels of the report.
+ */
+void parseLevels(const char* begin, const char* end, std::vector<int>& levels) {
+  levels.clear();
+  const char* current = begin;
+  while (current < end) {
+    // Skip the separators between levels
+    while (current < end && !std::isdigit(static_cast<unsigned char>(*current)) && *current != '-') { ++current; }
+    if (current == end) { break; }
+
+    bool negative = *current == '-';
+    if (negative) { ++current; }
+    int level = 0;
+    bool hasDigits = false;
+    while (current < end && std::isdigit(static_cast<unsigned char>(*current))) {
+      level = level * 10 + (*current++ - '0');
+      hasDigits = true;
+    }
+    if (hasDigits) { levels.push_back(negative ? -level : level); }
+  }
+}
+
+/**
+ * @brief Number of safe and unsafe reports classified.
+ */
+struct ReportCounts {
+  long long safe = 0;
+  long long unsafe = 0;
+};
+
+/**
+ * @brief Classifies reports one at a time: short reports wait in a batch for the SIMD kernel,
+ *        longer ones are checked by the scalar code right away.
+ */
+class ReportClassifier {
+ public:
+  explicit ReportClassifier(const SafetyPolicy& policy) : policy(policy) {}
+
+  void classify(const std::vector<int>& levels) {
+    if (!batch.add(levels)) {
+      if (isSafeUnderPolicy(levels, policy)) { counts.safe++; }
+      else { counts.unsafe++; }
+    } else if (batch.full()) {
+      flushBatch();
+    }
+  }
+
+  // Classify the reports still waiting in the batch and get the final counts
+  ReportCounts finish() {
+    flushBatch();
+    return counts;
+  }
+
+ private:
+  SafetyPolicy policy;
+  ReportBatch batch;
+  ReportCounts counts;
+
+  void flushBatch() {
+    int safeCount = countSafeInBatch(batch, policy);
+    counts.safe += safeCount;
+    counts.unsafe += batch.count - safeCount;
+    batch.count = 0;
+  }
+};
+
+/**
+ * @brief Classify the reports of a chunk of the input file.
+ *        A report belongs to the chunk its line starts in, so a worker skips the partial line at the
+ *        start of its chunk and reads past the end of the chunk to finish its last line.
+ * @param[in] filename: The name of the input file.
+ * @param[in] begin: The offset of the first byte of the chunk.
+ * @param[in] end: The offset one past the last byte of the chunk.
+ * @param[in] policy: The safety rules.
+ * @param[out] counts: The number of safe and unsafe reports of the chunk.
+ * @return True if the chunk was read, false otherwise.
+ */
+bool classifyChunk(const std::string& filename, std::streamoff begin, std::streamoff end, const SafetyPolicy& policy, ReportCounts& counts) {
+  std::ifstream inputFile(filename, std::ios::binary);
+  if (!inputFile) { return false; }
+
+  std::string line;
+  std::streamoff position = begin;
+  if (begin > 0) {
+    // Unless the previous byte ends a line, the first line belongs to the previous chunk
+    inputFile.seekg(begin - 1);
+    if (inputFile.get() != '\n') {
+      std::getline(inputFile, line);
+      position += line.size() + 1;
+    }
+  }
+
+  ReportClassifier classifier(policy);
+  std::vector<int> levels;
+  while (position < end && std::getline(inputFile, line)) {
+    position += line.size() + 1;
+    // Read all levels in the report
+    parseLevels(line.data(), line.data() + line.size(), levels);
+    classifier.classify(levels);
+  }
+
+  counts = classifier.finish();
+  inputFile.close();
+  return true;
+}
+
+/**
+ * @brief Check if a file is a regular file, the only kind that can be split into chunks or memory-mapped.
+ * @param[in] filename: The name of the file.
+ * @return True if the file is a regular file, false for pipes, devices or missing files.
+ */
+bool isRegularFile(const std::string& filename) {
+  struct stat fileStat;
+  return stat(filename.c_str(), &fileStat) == 0 && S_ISREG(fileStat.st_mode);
+}
+
 /**
  * @brief Count the number of safe reports in a file.
+ *        The file is split into one chunk per thread, and every worker classifies the reports
+ *        starting in its chunk with its own counters, merged once all of them finish.
+ *        Pipes and other non-seekable inputs cannot be split, they are read in one sequential pass.
  * @param[in] filename: The name of the input file.
- * @return The number of safe reports in the file.
+ * @param[in] policy: The safety rules.
+ * @param[in] threads: The number of worker threads.
+ * @param[out] counts: The number of safe and unsafe reports in the file.
+ * @return True if the file was read, false otherwise.
  */
-int countSafeReports(const std::string& filename) {
-  std::ifstream inputFile(filename);
+bool countSafeReports(const std::string& filename, const SafetyPolicy& policy, unsigned threads, ReportCounts& counts) {
+  const bool splittable = isRegularFile(filename);
+  std::ifstream inputFile(filename, std::ios::binary);
 
   // Check if the file was opened successfully
   if (!inputFile) {
     std::cerr << "Error: Could not open file " << filename << std::endl;
-    return -1;
+    return false;
   }
 
-  int safeCount = 0;
-  std::string line;
-  
-  while (std::getline(inputFile, line)) {
-    std::istringstream lineStream(line);
+  if (!splittable) {
+    ReportClassifier classifier(policy);
     std::vector<int> levels;
-    int level;
+    std::string line;
+    while (std::getline(inputFile, line)) {
+      parseLevels(line.data(), line.data() + line.size(), levels);
+      classifier.classify(levels);
+    }
+    counts = classifier.finish();
+    inputFile.close();
+    return true;
+  }
 
-    // Read all levels in the report
-    while (lineStream >> level) { levels.push_back(level); }
+  inputFile.seekg(0, std::ios::end);
+  const std::streamoff fileSize = inputFile.tellg();
+  inputFile.close();
+
+  // Small files are not worth splitting
+  threads = std::max<std::streamoff>(1, std::min<std::streamoff>(threads, fileSize / MIN_CHUNK_SIZE));
+  std::vector<ReportCounts> chunkCounts(threads);
+  std::vector<char> chunkRead(threads, false);
+  std::vector<std::thread> workers;
+  for (unsigned chunk = 0; chunk < threads; ++chunk) {
+    std::streamoff begin = fileSize * chunk / threads;
+    std::streamoff end = fileSize * (chunk + 1) / threads;
+    workers.emplace_back([&, chunk, begin, end]() {
+      chunkRead[chunk] = classifyChunk(filename, begin, end, policy, chunkCounts[chunk]);
+    });
+  }
+  for (std::thread& worker : workers) { worker.join(); }
+
+  // Merge the counters of every worker
+  counts = ReportCounts();
+  for (unsigned chunk = 0; chunk < threads; ++chunk) {
+    if (!chunkRead[chunk]) {
+      std::cerr << "Error: Could not read file " << filename << std::endl;
+      return false;
+    }
+    counts.safe += chunkCounts[chunk].safe;
+    counts.unsafe += chunkCounts[chunk].unsafe;
+  }
+
+  return true;
+}
+
+// Magic bytes at the start of a binary report cache
+const char CACHE_MAGIC[8] = {'A', 'O', 'C', '2', 'R', 'P', 'T', '1'};
+
+/**
+ * @brief Header of a binary report cache. The file layout is:
+ *        header | int8 levels of every report | padding to 8 bytes | uint64 offsets[reportCount + 1]
+ *        where the levels of report r are levels[offsets[r], offsets[r + 1]) (CSR layout).
+ */
+struct CacheHeader {
+  char magic[8];
+  uint64_t reportCount;
+  uint64_t levelCount;
+};
+
+/**
+ * @brief Convert a text report file into a binary report cache, so later runs skip the text parsing.
+ * @param[in] filename: The name of the input file.
+ * @param[in] cacheFilename: The name of the binary cache to write.
+ * @param[out] reportCount: The number of reports written.
+ * @return True if the cache was written, false otherwise.
+ */
+bool convertToCache(const std::string& filename, const std::string& cacheFilename, uint64_t& reportCount) {
+  std::ifstream inputFile(filename);
+  if (!inputFile) {
+    std::cerr << "Error: Could not open file " << filename << std::endl;
+    return false;
+  }
 
-    // Check if the report is safe directly or can be made safe
-    if (isSafeReport(levels) || canBeMadeSafe(levels)) { safeCount++; }
+  std::ofstream cacheFile(cacheFilename, std::ios::binary);
+  if (!cacheFile) {
+    std::cerr << "Error: Could not create file " << cacheFilename << std::endl;
+    return false;
   }
 
-  // Close the input file
+  // The header is written again once the counts are known
+  CacheHeader header;
+  std::copy(CACHE_MAGIC, CACHE_MAGIC + sizeof(CACHE_MAGIC), header.magic);
+  header.reportCount = header.levelCount = 0;
+  cacheFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  // Stream the levels, keeping only the offsets in memory
+  std::vector<uint64_t> offsets = {0};
+  std::vector<int> levels;
+  std::vector<int8_t> packedLevels;
+  std::string line;
+  while (std::getline(inputFile, line)) {
+    parseLevels(line.data(), line.data() + line.size(), levels);
+
+    packedLevels.clear();
+    for (int level : levels) {
+      if (level < INT8_MIN || level > INT8_MAX) {
+        std::cerr << "Error: Level " << level << " of report " << offsets.size() << " does not fit the cache." << std::endl;
+        cacheFile.close();
+        std::remove(cacheFilename.c_str());
+        return false;
+      }
+      packedLevels.push_back(level);
+    }
+    cacheFile.write(reinterpret_cast<const char*>(packedLevels.data()), packedLevels.size());
+    offsets.push_back(offsets.back() + packedLevels.size());
+  }
   inputFile.close();
-  return safeCount;
+
+  // Align the offsets, so the memory-mapped array can be read in place
+  header.reportCount = offsets.size() - 1;
+  header.levelCount = offsets.back();
+  const char padding[sizeof(uint64_t)] = {};
+  cacheFile.write(padding, (sizeof(uint64_t) - (sizeof(header) + header.levelCount) % sizeof(uint64_t)) % sizeof(uint64_t));
+  cacheFile.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+
+  cacheFile.seekp(0);
+  cacheFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  cacheFile.close();
+  if (!cacheFile) {
+    std::cerr << "Error: Could not write file " << cacheFilename << std::endl;
+    return false;
+  }
+
+  reportCount = header.reportCount;
+  return true;
+}
+
+/**
+ * @brief Check if a file is a binary report cache.
+ *        Only regular files are checked, reading the magic bytes of a pipe would consume them.
+ * @param[in] filename: The name of the file.
+ * @return True if the file starts with the cache magic bytes, false otherwise.
+ */
+bool isReportCache(const std::string& filename) {
+  if (!isRegularFile(filename)) { return false; }
+  std::ifstream inputFile(filename, std::ios::binary);
+  char magic[sizeof(CACHE_MAGIC)];
+  return inputFile.read(magic, sizeof(magic)) && std::equal(magic, magic + sizeof(magic), CACHE_MAGIC);
+}
+
+/**
+ * @brief Count the number of safe reports in a binary report cache.
+ *        The cache is memory-mapped and its reports are split into one range per thread, so nothing is parsed.
+ * @param[in] filename: The name of the binary cache.
+ * @param[in] policy: The safety rules.
+ * @param[in] threads: The number of worker threads.
+ * @param[out] counts: The number of safe and unsafe reports in the cache.
+ * @return True if the cache was read, false otherwise.
+ */
+bool countSafeReportsInCache(const std::string& filename, const SafetyPolicy& policy, unsigned threads, ReportCounts& counts) {
+  int descriptor = open(filename.c_str(), O_RDONLY);
+  struct stat fileStat;
+  if (descriptor == -1 || fstat(descriptor, &fileStat) == -1) {
+    std::cerr << "Error: Could not open file " << filename << std::endl;
+    if (descriptor != -1) { close(descriptor); }
+    return false;
+  }
+
+  const size_t fileSize = fileStat.st_size;
+  void* mapping = fileSize > 0 ? mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, descriptor, 0) : MAP_FAILED;
+  close(descriptor);
+  if (mapping == MAP_FAILED) {
+    std::cerr << "Error: Could not map file " << filename << std::endl;
+    return false;
+  }
+
+  // Validate the layout before trusting the offsets
+  const char* data = static_cast<const char*>(mapping);
+  CacheHeader header;
+  bool valid = fileSize >= sizeof(header);
+  uint64_t offsetsStart = 0;
+  if (valid) {
+    std::copy(data, data + sizeof(header), reinterpret_cast<char*>(&header));
+    valid = header.levelCount <= fileSize - sizeof(header);
+  }
+  if (valid) {
+    offsetsStart = (sizeof(header) + header.levelCount + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+    valid = offsetsStart <= fileSize && header.reportCount < fileSize &&
+            (fileSize - offsetsStart) / sizeof(uint64_t) == header.reportCount + 1;
+  }
+  if (valid) {
+    // Every report must be a range of the levels: the offsets start at 0, never decrease and end at levelCount
+    const uint64_t* offsets = reinterpret_cast<const uint64_t*>(data + offsetsStart);
+    valid = offsets[0] == 0 && offsets[header.reportCount] == header.levelCount;
+    for (uint64_t r = 0; valid && r < header.reportCount; ++r) { valid = offsets[r] <= offsets[r + 1]; }
+  }
+  if (!valid) {
+    std::cerr << "Error: File " << filename << " is not a valid report cache." << std::endl;
+    munmap(mapping, fileSize);
+    return false;
+  }
+
+  const int8_t* levels = reinterpret_cast<const int8_t*>(data + sizeof(header));
+  const uint64_t* offsets = reinterpret_cast<const uint64_t*>(data + offsetsStart);
+
+  // Every worker classifies a contiguous range of reports with its own counters
+  threads = std::max<uint64_t>(1, std::min<uint64_t>(threads, header.reportCount / BATCH_SIZE));
+  std::vector<ReportCounts> rangeCounts(threads);
+  std::vector<std::thread> workers;
+  for (unsigned range = 0; range < threads; ++range) {
+    workers.emplace_back([&, range]() {
+      ReportClassifier classifier(policy);
+      std::vector<int> report;
+      const uint64_t first = header.reportCount * range / threads;
+      const uint64_t last = header.reportCount * (range + 1) / threads;
+      for (uint64_t r = first; r < last; ++r) {
+        report.assign(levels + offsets[r], levels + offsets[r + 1]);
+        classifier.classify(report);
+      }
+      rangeCounts[range] = classifier.finish();
+    });
+  }
+  for (std::thread& worker : workers) { worker.join(); }
+  munmap(mapping, fileSize);
+
+  // Merge the counters of every worker
+  counts = ReportCounts();
+  for (const ReportCounts& range : rangeCounts) {
+    counts.safe += range.safe;
+    counts.unsafe += range.unsafe;
+  }
+
+  return true;
 }
 
 int main(int argc, char* argv[]) {
   // Check if the input file was provided
-  if (argc != 2) {
-    std::cerr << "Usage: " << argv[0] << " <input_file>" << std::endl;
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <input_file> [-min-step <n>] [-max-step <n>] [-removals <k>] [-threads <n>] [-convert <cache_file>]" << std::endl;
     return EXIT_FAILURE;
   }
 
-  int safeReports = countSafeReports(argv[1]);
+  // Read the safety policy, by default steps within [1, 3] and one removal
+  SafetyPolicy policy;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string cacheFilename;
+  for (int i = 2; i < argc; ++i) {
+    std::string option = argv[i];
+    if (i + 1 < argc && option == "-min-step") { policy.minStep = std::atoi(argv[++i]); }
+    else if (i + 1 < argc && option == "-max-step") { policy.maxStep = std::atoi(argv[++i]); }
+    else if (i + 1 < argc && option == "-removals") {
+      // Parsed wide and range-checked before the narrowing, so values past the int range are rejected instead of wrapping
+      long long removals = std::atoll(argv[++i]);
+      policy.maxRemovals = removals < 0 || removals > MAX_REMOVALS ? -1 : static_cast<int>(removals);
+    }
+    else if (i + 1 < argc && option == "-threads") { threads = std::max(1, std::atoi(argv[++i])); }
+    else if (i + 1 < argc && option == "-convert") { cacheFilename = argv[++i]; }
+    else {
+      std::cerr << "Error: Unknown option " << option << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (policy.minStep < 0 || policy.minStep > policy.maxStep || policy.maxRemovals < 0) {
+    std::cerr << "Error: The policy needs 0 <= min-step <= max-step and 0 <= removals <= " << MAX_REMOVALS << "." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Write the binary report cache of a text input file
+  if (!cacheFilename.empty()) {
+    uint64_t reportCount;
+    if (!convertToCache(argv[1], cacheFilename, reportCount)) { return EXIT_FAILURE; }
+    std::cout << "Reports written to " << cacheFilename << ": " << reportCount << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  // Binary report caches are memory-mapped, text files are parsed
+  ReportCounts counts;
+  bool counted = isReportCache(argv[1]) ? countSafeReportsInCache(argv[1], policy, threads, counts)
+                                        : countSafeReports(argv[1], policy, threads, counts);
   // There was an error reading the input file
-  if (safeReports == -1) { return EXIT_FAILURE; }
+  if (!counted) { return EXIT_FAILURE; }
 
-  std::cout << "The number of safe reports is: " << safeReports << std::endl;
+  std::cout << "The number of safe reports is: " << counts.safe << std::endl;
+  std::cout << "The number of unsafe reports is: " << counts.unsafe << std::endl;
 
   return EXIT_SUCCESS;
 }
@@ -11,56 +11,453 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <regex>
+#include <array>
+#include <string_view>
+#include <type_traits>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// What an instruction does once it is recognised
+enum class InstructionEffect : uint8_t {
+  MULTIPLY, // Add the product of its operands to the sum, if mul instructions are enabled
+  ENABLE,   // Enable the mul instructions
+  DISABLE   // Disable the mul instructions
+};
+
+// Instructions of the puzzle: mul(X,Y) with 1 to 3 digit operands, do() and don't()
+struct MulInstruction {
+  static constexpr std::string_view opcode = "mul";
+  static constexpr int arity = 2;
+  static constexpr int maxDigits = 3;
+  static constexpr InstructionEffect effect = InstructionEffect::MULTIPLY;
+};
+
+struct DoInstruction {
+  static constexpr std::string_view opcode = "do";
+  static constexpr int arity = 0;
+  static constexpr int maxDigits = 0;
+  static constexpr InstructionEffect effect = InstructionEffect::ENABLE;
+};
+
+struct DontInstruction {
+  static constexpr std::string_view opcode = "don't";
+  static constexpr int arity = 0;
+  static constexpr int maxDigits = 0;
+  static constexpr InstructionEffect effect = InstructionEffect::DISABLE;
+};
+
+// What the scanner does when it enters a state
+enum ScannerActionKind : uint8_t { NO_ACTION, RESET_OPERANDS, APPEND_DIGIT, ACCEPT };
+
+struct ScannerAction {
+  ScannerActionKind kind = NO_ACTION;
+  uint8_t index = 0; // Operand of APPEND_DIGIT, instruction of ACCEPT
+};
+
+/**
+ * @brief Tables of the scanner of a grammar, an instruction being opcode(operand,...,operand).
+ *        States are the nodes of a trie of the "opcode(" prefixes, followed by one state per operand digit,
+ *        one per comma and one accepting state per instruction. The capacity is an upper bound of the
+ *        number of states, the trie shares the common prefixes of the opcodes.
+ */
+template <typename... Instructions>
+struct GrammarTables {
+  static constexpr size_t INSTRUCTION_COUNT = sizeof...(Instructions);
+  static constexpr size_t MAX_ARITY = std::max({size_t(1), size_t(Instructions::arity)...});
+  static constexpr size_t STATE_CAPACITY = 1 + ((Instructions::opcode.size() + 1 + Instructions::arity * Instructions::maxDigits +
+                                                 std::max(Instructions::arity - 1, 0) + 1) + ...);
+  using State = std::conditional_t<STATE_CAPACITY <= 256, uint8_t, uint16_t>;
+
+  std::array<std::array<State, 256>, STATE_CAPACITY> next{};
+  std::array<ScannerAction, STATE_CAPACITY> actions{};
+  std::array<bool, STATE_CAPACITY> idle{};         // States whose transitions are the START ones
+  std::array<InstructionEffect, INSTRUCTION_COUNT> effects{};
+  std::array<int, INSTRUCTION_COUNT> arities{};
+  std::array<char, INSTRUCTION_COUNT> startBytes{}; // Distinct first bytes of the opcodes
+  size_t startByteCount = 0;
+};
+
+/**
+ * @brief Check at compile time that a grammar can be scanned with restarts: opcodes are distinct and
+ *        non-empty, and the first byte of an opcode never appears anywhere else in an instruction.
+ *        When a byte breaks the current instruction, the scanner can then restart from that same byte.
+ * @return True if the grammar is valid, false otherwise.
+ */
+template <typename... Instructions>
+constexpr bool isValidGrammar() {
+  constexpr std::array<std::string_view, sizeof...(Instructions)> opcodes = {Instructions::opcode...};
+  constexpr std::array<int, sizeof...(Instructions)> arities = {Instructions::arity...};
+  constexpr std::array<int, sizeof...(Instructions)> maxDigits = {Instructions::maxDigits...};
+
+  for (size_t i = 0; i < opcodes.size(); ++i) {
+    if (opcodes[i].empty()) { return false; }
+    // Operands are 64-bit, and the product of all of them must fit
+    if (arities[i] < 0 || (arities[i] > 0 && maxDigits[i] < 1) || arities[i] * maxDigits[i] > 18) { return false; }
+
+    const char start = opcodes[i][0];
+    if ((start >= '0' && start <= '9') || start == '(' || start == ',' || start == ')') { return false; }
+    for (size_t j = 0; j < opcodes.size(); ++j) {
+      if (i != j && opcodes[i] == opcodes[j]) { return false; }
+      for (size_t k = 1; k < opcodes[j].size(); ++k) {
+        if (opcodes[j][k] == start) { return false; }
+      }
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief Build the scanner tables of a grammar.
+ * @return The tables of the grammar.
+ */
+template <typename... Instructions>
+constexpr GrammarTables<Instructions...> buildGrammarTables() {
+  constexpr std::array<std::string_view, sizeof...(Instructions)> opcodes = {Instructions::opcode...};
+  constexpr std::array<int, sizeof...(Instructions)> arities = {Instructions::arity...};
+  constexpr std::array<int, sizeof...(Instructions)> maxDigits = {Instructions::maxDigits...};
+  constexpr std::array<InstructionEffect, sizeof...(Instructions)> effects = {Instructions::effect...};
+
+  // State 0 is START, a zero transition is a missing one until the restarts are filled in
+  GrammarTables<Instructions...> tables{};
+  size_t stateCount = 1;
+  tables.idle[0] = true;
+
+  for (size_t i = 0; i < opcodes.size(); ++i) {
+    tables.effects[i] = effects[i];
+    tables.arities[i] = arities[i];
+
+    // Insert "opcode(" in the trie
+    size_t node = 0;
+    for (size_t k = 0; k <= opcodes[i].size(); ++k) {
+      const unsigned char byte = k < opcodes[i].size() ? opcodes[i][k] : '(';
+      if (tables.next[node][byte] == 0) { tables.next[node][byte] = stateCount++; }
+      node = tables.next[node][byte];
+    }
+    if (arities[i] > 0) { tables.actions[node].kind = RESET_OPERANDS; }
+
+    // Operands: 1 to maxDigits digit states each, followed by a comma or the closing parenthesis
+    size_t following = node;
+    size_t digitStates[18] = {};
+    for (int operand = 0; operand < arities[i]; ++operand) {
+      size_t previous = following;
+      for (int digit = 0; digit < maxDigits[i]; ++digit) {
+        digitStates[digit] = stateCount++;
+        tables.actions[digitStates[digit]] = {APPEND_DIGIT, static_cast<uint8_t>(operand)};
+        for (unsigned char byte = '0'; byte <= '9'; ++byte) { tables.next[previous][byte] = digitStates[digit]; }
+        previous = digitStates[digit];
+      }
+
+      const unsigned char separator = operand + 1 == arities[i] ? ')' : ',';
+      following = stateCount++;
+      for (int digit = 0; digit < maxDigits[i]; ++digit) { tables.next[digitStates[digit]][separator] = following; }
+    }
+    if (arities[i] == 0) {
+      following = stateCount++;
+      tables.next[node][')'] = following;
+    }
+
+    // The state after the closing parenthesis accepts the instruction
+    tables.actions[following] = {ACCEPT, static_cast<uint8_t>(i)};
+    tables.idle[following] = true;
+
+    bool newStart = true;
+    for (size_t k = 0; k < tables.startByteCount; ++k) { newStart = newStart && tables.startBytes[k] != opcodes[i][0]; }
+    if (newStart) { tables.startBytes[tables.startByteCount++] = opcodes[i][0]; }
+  }
+
+  // A byte that breaks an instruction restarts the scan from that same byte
+  for (size_t state = 1; state < stateCount; ++state) {
+    for (size_t byte = 0; byte < 256; ++byte) {
+      if (tables.next[state][byte] == 0) { tables.next[state][byte] = tables.next[0][byte]; }
+    }
+  }
+
+  return tables;
+}
+
+/**
+ * @brief Instruction set of a scanner, declared at compile time.
+ *        Every grammar gets its own tables and every scanner function is instantiated per grammar,
+ *        so the hot loop never dispatches on the instruction set at runtime.
+ */
+template <typename... Instructions>
+struct InstructionGrammar {
+  static_assert(isValidGrammar<Instructions...>(),
+                "Opcodes must be distinct and non-empty, their first byte cannot appear anywhere else in an instruction, "
+                "and the operands of an instruction cannot have more than 18 digits in total.");
+
+  using Tables = GrammarTables<Instructions...>;
+  using State = typename Tables::State;
+  static constexpr size_t MAX_ARITY = Tables::MAX_ARITY;
+  static constexpr Tables TABLES = buildGrammarTables<Instructions...>();
+};
+
+// Grammar of the puzzle
+using PuzzleGrammar = InstructionGrammar<MulInstruction, DoInstruction, DontInstruction>;
+
+// Smallest chunk of the corrupted memory handed to a worker thread
+const size_t MIN_CHUNK_SIZE = 1 << 16;
+// Size of the read buffer of the streaming mode
+const size_t STREAM_BUFFER_SIZE = 1 << 16;
+
+/**
+ * @brief Find the next byte that may start an instruction of a grammar (the first byte of an opcode).
+ *        Compares 64 bytes per iteration with AVX2 (16 with SSE2) and only looks at the compare masks,
+ *        so the noise between instructions is skipped close to memory bandwidth.
+ * @param[in] current: The first byte to search.
+ * @param[in] end: One past the last byte to search.
+ * @return The position of the next candidate byte, or end if there is none.
+ */
+template <typename Grammar>
+inline const char* findInstructionStart(const char* current, const char* end) {
+  constexpr auto& tables = Grammar::TABLES;
+
+#if defined(__AVX2__)
+  for (; current + 64 <= end; current += 64) {
+    __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current));
+    __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + 32));
+    __m256i lowMatches = _mm256_setzero_si256(), highMatches = _mm256_setzero_si256();
+    for (size_t k = 0; k < tables.startByteCount; ++k) {
+      const __m256i start = _mm256_set1_epi8(tables.startBytes[k]);
+      lowMatches = _mm256_or_si256(lowMatches, _mm256_cmpeq_epi8(low, start));
+      highMatches = _mm256_or_si256(highMatches, _mm256_cmpeq_epi8(high, start));
+    }
+    uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(lowMatches)) |
+                    (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(highMatches))) << 32);
+    if (mask != 0) { return current + __builtin_ctzll(mask); }
+  }
+#elif defined(__SSE2__)
+  for (; current + 16 <= end; current += 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+    __m128i matches = _mm_setzero_si128();
+    for (size_t k = 0; k < tables.startByteCount; ++k) {
+      matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, _mm_set1_epi8(tables.startBytes[k])));
+    }
+    int mask = _mm_movemask_epi8(matches);
+    if (mask != 0) { return current + __builtin_ctz(mask); }
+  }
+#endif
+
+  // Remaining bytes: only the first bytes of the opcodes leave START
+  while (current < end && tables.next[0][static_cast<unsigned char>(*current)] == 0) { ++current; }
+  return current;
+}
+
+// Last control instruction seen in a chunk
+enum Toggle : uint8_t { NO_TOGGLE, ENABLE, DISABLE };
+
+/**
+ * @brief Summary of a chunk of corrupted memory, valid whatever the state the chunk starts in.
+ *        Summaries are combined in order with combineSummaries, which is associative.
+ */
+struct ChunkSummary {
+  long long enabledSum = 0;       // Sum of the chunk if mul instructions are enabled at its start
+  long long disabledSum = 0;      // Sum of the chunk if mul instructions are disabled at its start
+  Toggle lastToggle = NO_TOGGLE;  // Last do() or don't() of the chunk
+};
+
+/**
+ * @brief Combine the summaries of two consecutive chunks.
+ * @param[in] first: The summary of the first chunk.
+ * @param[in] second: The summary of the chunk right after it.
+ * @return The summary of both chunks together.
+ */
+ChunkSummary combineSummaries(const ChunkSummary& first, const ChunkSummary& second) {
+  ChunkSummary combined;
+  // The second chunk starts in the state left by the last toggle of the first one, if any
+  combined.enabledSum = first.enabledSum + (first.lastToggle == DISABLE ? second.disabledSum : second.enabledSum);
+  combined.disabledSum = first.disabledSum + (first.lastToggle == ENABLE ? second.enabledSum : second.disabledSum);
+  combined.lastToggle = second.lastToggle != NO_TOGGLE ? second.lastToggle : first.lastToggle;
+  return combined;
+}
+
+/**
+ * @brief Scanner of the instructions of a grammar, resumable between consecutive pieces of input.
+ */
+template <typename Grammar>
+struct InstructionScanner {
+  typename Grammar::State state = 0;
+  std::array<long long, Grammar::MAX_ARITY> operands{};
+  ChunkSummary summary;
+
+  // Feed one byte to the state machine
+  inline void step(unsigned char byte) {
+    constexpr auto& tables = Grammar::TABLES;
+    state = tables.next[state][byte];
+    const ScannerAction action = tables.actions[state];
+    switch (action.kind) {
+      case RESET_OPERANDS: operands.fill(0); break;
+      case APPEND_DIGIT: operands[action.index] = operands[action.index] * 10 + (byte - '0'); break;
+      case ACCEPT: execute(action.index); break;
+      default: break;
+    }
+  }
+
+  // Apply the effect of a recognised instruction
+  void execute(size_t instruction) {
+    constexpr auto& tables = Grammar::TABLES;
+    switch (tables.effects[instruction]) {
+      case InstructionEffect::MULTIPLY: {
+        long long product = 1;
+        for (int operand = 0; operand < tables.arities[instruction]; ++operand) { product *= operands[operand]; }
+        // Before any toggle the product only counts if the chunk starts enabled
+        if (summary.lastToggle == NO_TOGGLE) { summary.enabledSum += product; }
+        else if (summary.lastToggle == ENABLE) {
+          summary.enabledSum += product;
+          summary.disabledSum += product;
+        }
+        break;
+      }
+      case InstructionEffect::ENABLE: summary.lastToggle = ENABLE; break;
+      case InstructionEffect::DISABLE: summary.lastToggle = DISABLE; break;
+    }
+  }
+
+  // Scan every byte of a piece of input, jumping over the noise between instructions
+  void scan(const char* current, const char* end) {
+    while (current < end) {
+      if (Grammar::TABLES.idle[state]) {
+        current = findInstructionStart<Grammar>(current, end);
+        if (current == end) { break; }
+      }
+      step(*current++);
+    }
+  }
+
+  // Finish the instruction in progress with the bytes after the chunk, without starting a new one
+  void finishInstruction(const char* current, const char* limit) {
+    constexpr auto& tables = Grammar::TABLES;
+    while (!tables.idle[state] && current < limit) {
+      const unsigned char byte = *current;
+      // The instruction broke and the scan restarts: whatever comes next belongs to the following chunk
+      if (tables.next[state][byte] == tables.next[0][byte]) { return; }
+      step(byte);
+      ++current;
+    }
+  }
+};
 
 /**
  * @brief Extract and sum the valid mul instructions from a corrupted memory.
+ *        The memory is split into chunks scanned in parallel. An instruction belongs to the chunk it starts
+ *        in, so a worker reads past the end of its chunk to finish a straddling instruction, while the
+ *        bytes of that instruction can never start a new one in the next chunk. The chunk summaries are
+ *        then combined in order, which gives exactly the serial result.
+ * @tparam Grammar: The instruction set to recognise.
  * @param[in] input: The corrupted memory containing mul and control instructions.
+ * @param[in] threads: The number of worker threads.
  * @return The total sum of valid mul instructions.
  */
-int extractAndSumValidInstructions(const std::string& input) {
-  // Regex to match valid mul(X,Y) and control instructions do(), don't()
-  std::regex instructionRegex(R"(mul\((\d{1,3}),(\d{1,3})\)|do\(\)|don't\(\))");
+template <typename Grammar = PuzzleGrammar>
+long long extractAndSumValidInstructions(const std::string& input, unsigned threads) {
+  // Small inputs are not worth splitting
+  threads = std::max<size_t>(1, std::min<size_t>(threads, input.size() / MIN_CHUNK_SIZE));
+
+  const char* memory = input.data();
+  const size_t size = input.size();
+  std::vector<ChunkSummary> summaries(threads);
+  std::vector<std::thread> workers;
+  for (unsigned chunk = 0; chunk < threads; ++chunk) {
+    workers.emplace_back([&, chunk]() {
+      InstructionScanner<Grammar> scanner;
+      scanner.scan(memory + size * chunk / threads, memory + size * (chunk + 1) / threads);
+      scanner.finishInstruction(memory + size * (chunk + 1) / threads, memory + size);
+      summaries[chunk] = scanner.summary;
+    });
+  }
+  for (std::thread& worker : workers) { worker.join(); }
 
-  std::smatch match;
-  std::string::const_iterator searchStart(input.cbegin());
+  ChunkSummary total;
+  for (const ChunkSummary& summary : summaries) { total = combineSummaries(total, summary); }
 
-  int totalSum = 0;
   // The program starts with mul instructions enabled
-  bool isEnabled = true; 
-
-  // Process all instructions
-  while (std::regex_search(searchStart, input.cend(), match, instructionRegex)) {
-    std::string instruction = match.str();
-
-    if (instruction == "do()") { isEnabled = true; } 
-    else if (instruction == "don't()") { isEnabled = false; } 
-    else if (isEnabled) {
-      // Extract and calculate mul(X,Y) if enabled
-      int x = std::stoi(match[1]);
-      int y = std::stoi(match[2]);
-      totalSum += x * y;
-    }
+  return total.enabledSum;
+}
+
+/**
+ * @brief Extract and sum the valid mul instructions of a stream in constant memory.
+ *        The input is read in fixed-size buffers, and the scanner state (current instruction prefix and
+ *        its operands so far) is all that carries over from one buffer to the next.
+ * @tparam Grammar: The instruction set to recognise.
+ * @param[in] descriptor: The file descriptor to read from.
+ * @param[out] totalSum: The total sum of valid mul instructions.
+ * @return True if the whole stream was read, false otherwise.
+ */
+template <typename Grammar = PuzzleGrammar>
+bool streamAndSumValidInstructions(int descriptor, long long& totalSum) {
+  static char buffer[STREAM_BUFFER_SIZE];
+  InstructionScanner<Grammar> scanner;
 
-    // Move the search start to after the current match
-    searchStart = match.suffix().first;
+  while (true) {
+    ssize_t bytesRead = read(descriptor, buffer, sizeof(buffer));
+    if (bytesRead == 0) { break; }
+    if (bytesRead < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+    scanner.scan(buffer, buffer + bytesRead);
   }
 
-  return totalSum;
+  // The program starts with mul instructions enabled
+  totalSum = scanner.summary.enabledSum;
+  return true;
 }
 
-
 int main(int argc, char* argv[]) {
   // Check if the input file was provided
-  if (argc != 2) {
-    std::cerr << "Usage: " << argv[0] << " <input_file>" << std::endl;
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <input_file | -> [-threads <n>] [-stream]" << std::endl;
     return EXIT_FAILURE;
   }
 
-  std::ifstream inputFile(argv[1]);
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  bool stream = false;
+  for (int i = 2; i < argc; ++i) {
+    std::string option = argv[i];
+    if (i + 1 < argc && option == "-threads") { threads = std::max(1, std::atoi(argv[++i])); }
+    else if (option == "-stream") { stream = true; }
+    else {
+      std::cerr << "Error: Unknown option " << option << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Streaming mode: constant memory, reading the file or the standard input ("-") buffer by buffer
+  const std::string filename = argv[1];
+  if (stream || filename == "-") {
+    int descriptor = filename == "-" ? STDIN_FILENO : open(filename.c_str(), O_RDONLY);
+    if (descriptor == -1) {
+      std::cerr << "Error: Could not open file " << filename << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    long long result;
+    bool completed = streamAndSumValidInstructions(descriptor, result);
+    if (descriptor != STDIN_FILENO) { close(descriptor); }
+    if (!completed) {
+      std::cerr << "Error: Could not read " << filename << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::cout << "The total sum of valid mul instructions is: " << result << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  std::ifstream inputFile(filename);
   // Check if the input file can be opened
   if (!inputFile) {
-    std::cerr << "Error: Could not open file " << argv[1] << std::endl;
+    std::cerr << "Error: Could not open file " << filename << std::endl;
     return EXIT_FAILURE;
   }
 
@@ -69,7 +466,7 @@ int main(int argc, char* argv[]) {
   // Close the input file
   inputFile.close();
 
-  int result = extractAndSumValidInstructions(corruptedMemory);
+  long long result = extractAndSumValidInstructions(corruptedMemory, threads);
   std::cout << "The total sum of valid mul instructions is: " << result << std::endl;
 
   return EXIT_SUCCESS;
@@ -12,6 +12,12 @@
 #include <fstream>
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <array>
+#include <map>
+#include <thread>
 
 const std::string WORD = "XMAS";
 
@@ -27,114 +33,613 @@ const std::vector<std::pair<int, int>> DIRECTIONS = {
   {-1, 1}   // Up-right
 };
 
-// Function to check if a word starts at grid[row][col] in a specific direction
-bool isWordAtPosition(const std::vector<std::string>& grid, int row, int col, int dRow, int dCol) {
-  int rows = grid.size();
-  int cols = grid[0].size();
+// Letters with a bitplane: the letters of WORD, which include the M, A and S of the X-MAS pattern
+const std::string BITPLANE_LETTERS = "XMAS";
 
-  for (int i = 0; i < WORD.size(); ++i) {
-    int newRow = row + i * dRow;
-    int newCol = col + i * dCol;
-    if (newRow < 0 || newRow >= rows || 
-        newCol < 0 || newCol >= cols || 
-        grid[newRow][newCol] != WORD[i]) 
-      { return false; }
+// Grid encoded as one bitplane per letter: bit (col % 64) of word (col / 64) of a row is set if the cell holds the letter
+struct GridBitplanes {
+  int rows = 0, cols = 0, words = 0;
+  std::vector<std::vector<uint64_t>> planes;
+
+  // Row of the bitplane of a letter
+  const uint64_t* row(char letter, int row) const {
+    return planes[BITPLANE_LETTERS.find(letter)].data() + static_cast<size_t>(row) * words;
+  }
+};
+
+// Function to encode the grid as bitplanes
+GridBitplanes buildBitplanes(const std::vector<std::string>& grid) {
+  GridBitplanes bitplanes;
+  bitplanes.rows = grid.size();
+  for (const auto& line : grid) { bitplanes.cols = std::max<int>(bitplanes.cols, line.size()); }
+  bitplanes.words = (bitplanes.cols + 63) / 64;
+
+  bitplanes.planes.assign(BITPLANE_LETTERS.size(), std::vector<uint64_t>(static_cast<size_t>(bitplanes.rows) * bitplanes.words, 0));
+  for (int row = 0; row < bitplanes.rows; ++row) {
+    for (int col = 0; col < static_cast<int>(grid[row].size()); ++col) {
+      size_t letter = BITPLANE_LETTERS.find(grid[row][col]);
+      if (letter == std::string::npos) { continue; }
+      bitplanes.planes[letter][static_cast<size_t>(row) * bitplanes.words + col / 64] |= uint64_t(1) << (col % 64);
+    }
   }
-  return true;
+  return bitplanes;
 }
 
-// Function to find all instances of "XMAS" in the grid
-int findAllOccurrences(const std::vector<std::string>& grid, std::vector<std::string>& highlightedGrid) {
-  int rows = grid.size();
-  int cols = grid[0].size();
-  int count = 0;
+// Function to get 64 cells of a bitplane row starting at column 64 * word + offset (cells outside the row are 0)
+inline uint64_t shiftedWord(const uint64_t* row, int words, int word, int offset) {
+  if (offset > 0) {
+    uint64_t next = word + 1 < words ? row[word + 1] << (64 - offset) : 0;
+    return (row[word] >> offset) | next;
+  }
+  if (offset < 0) {
+    uint64_t previous = word > 0 ? row[word - 1] >> (64 + offset) : 0;
+    return (row[word] << -offset) | previous;
+  }
+  return row[word];
+}
 
-  // Initialize highlighted grid with dots
-  highlightedGrid = std::vector<std::string>(rows, std::string(cols, '.'));
+// Function to get the 64 starting cells of a word of the first row where WORD is found, letterRows[i] holding its i-th letter
+inline uint64_t wordMatches(const uint64_t* const* letterRows, int words, int word, int dCol) {
+  uint64_t matches = ~uint64_t(0);
+  for (int i = 0; i < static_cast<int>(WORD.size()) && matches != 0; ++i) {
+    matches &= shiftedWord(letterRows[i], words, word, i * dCol);
+  }
+  return matches;
+}
 
-  for (int row = 0; row < rows; ++row) {
-    for (int col = 0; col < cols; ++col) {
-      // Check for "XMAS" starting from this position in all directions
+// Rows a band reads past its own starting rows: a word reaches WORD.size() - 1 rows up or down
+const int HALO_ROWS = 3;
+// Fewest starting rows handed to a worker thread
+const int MIN_BAND_ROWS = 64;
+
+// Highlighted cells of a band: its own rows plus the halo rows above and below
+struct BandHighlights {
+  int firstRow = 0;
+  std::vector<std::string> rows;
+
+  void mark(const std::vector<std::string>& grid, int row, int col) { rows[row - firstRow][col] = grid[row][col]; }
+};
+
+// Function to split the starting rows [firstRow, lastRow) into bands searched in parallel, summing the per-band counts.
+// The bitplanes are only read, and every band highlights into its own grid, merged after the workers are joined
+template <typename BandSearch>
+long long searchInBands(const std::vector<std::string>& grid, int firstRow, int lastRow, int cols, unsigned threads,
+                        std::vector<std::string>* highlightedGrid, BandSearch search) {
+  const int rows = grid.size();
+  const int startingRows = std::max(0, lastRow - firstRow);
+  const int bands = std::max(1, std::min<int>(threads, startingRows / MIN_BAND_ROWS));
+
+  std::vector<long long> counts(bands, 0);
+  std::vector<BandHighlights> highlights(highlightedGrid != nullptr ? bands : 0);
+  std::vector<std::thread> workers;
+  for (int band = 0; band < bands; ++band) {
+    workers.emplace_back([&, band]() {
+      int begin = firstRow + static_cast<long long>(startingRows) * band / bands;
+      int end = firstRow + static_cast<long long>(startingRows) * (band + 1) / bands;
+
+      BandHighlights* bandHighlights = nullptr;
+      if (highlightedGrid != nullptr) {
+        bandHighlights = &highlights[band];
+        bandHighlights->firstRow = std::max(0, begin - HALO_ROWS);
+        bandHighlights->rows.assign(std::min(rows, end + HALO_ROWS) - bandHighlights->firstRow, std::string(cols, '.'));
+      }
+      counts[band] = search(begin, end, bandHighlights);
+    });
+  }
+  for (std::thread& worker : workers) { worker.join(); }
+
+  if (highlightedGrid != nullptr) {
+    // Initialize highlighted grid with dots, then copy the letters highlighted by every band
+    *highlightedGrid = std::vector<std::string>(rows, std::string(cols, '.'));
+    for (const auto& bandHighlights : highlights) {
+      for (size_t row = 0; row < bandHighlights.rows.size(); ++row) {
+        std::string& target = (*highlightedGrid)[bandHighlights.firstRow + row];
+        for (int col = 0; col < cols; ++col) {
+          if (bandHighlights.rows[row][col] != '.') { target[col] = bandHighlights.rows[row][col]; }
+        }
+      }
+    }
+  }
+
+  long long count = 0;
+  for (long long bandCount : counts) { count += bandCount; }
+  return count;
+}
+
+// Function to find all instances of "XMAS" in the grid, 64 cells at a time for every direction (highlighting only if highlightedGrid is given)
+long long findAllOccurrences(const std::vector<std::string>& grid, const GridBitplanes& bitplanes, unsigned threads,
+                             std::vector<std::string>* highlightedGrid) {
+  const int rows = bitplanes.rows;
+  const int length = WORD.size();
+
+  return searchInBands(grid, 0, rows, bitplanes.cols, threads, highlightedGrid, [&](int begin, int end, BandHighlights* highlights) {
+    long long count = 0;
+    std::vector<const uint64_t*> letterRows(length);
+    for (int row = begin; row < end; ++row) {
       for (const auto& dir : DIRECTIONS) {
-        if (isWordAtPosition(grid, row, col, dir.first, dir.second)) {
-          count++;
+        // The whole word must fit vertically
+        int lastRow = row + (length - 1) * dir.first;
+        if (lastRow < 0 || lastRow >= rows) { continue; }
+
+        for (int i = 0; i < length; ++i) { letterRows[i] = bitplanes.row(WORD[i], row + i * dir.first); }
+        for (int word = 0; word < bitplanes.words; ++word) {
+          uint64_t matches = wordMatches(letterRows.data(), bitplanes.words, word, dir.second);
+          count += __builtin_popcountll(matches);
+          if (highlights == nullptr) { continue; }
+
           // Highlight the word in the result grid
-          for (int i = 0; i < WORD.size(); ++i) {
-            int newRow = row + i * dir.first;
-            int newCol = col + i * dir.second;
-            highlightedGrid[newRow][newCol] = grid[newRow][newCol];
+          for (; matches != 0; matches &= matches - 1) {
+            int col = word * 64 + __builtin_ctzll(matches);
+            for (int i = 0; i < length; ++i) { highlights->mark(grid, row + i * dir.first, col + i * dir.second); }
           }
         }
       }
     }
-  }
-  return count;
+    return count;
+  });
 }
 
-// Function to check if an X-MAS pattern exists at a given position
-bool isXMASPattern(const std::vector<std::string>& grid, int row, int col) {
-  int rows = grid.size();
-  int cols = grid[0].size();
-
-  // Check the X-MAS pattern
-  return (
-    (grid[row - 1][col - 1] == 'M' && grid[row + 1][col + 1] == 'S' && grid[row][col] == 'A' || 
-     grid[row - 1][col - 1] == 'S' && grid[row + 1][col + 1] == 'M' && grid[row][col] == 'A') && 
-    (grid[row - 1][col + 1] == 'M' && grid[row + 1][col - 1] == 'S' && grid[row][col] == 'A' || 
-     grid[row - 1][col + 1] == 'S' && grid[row + 1][col - 1] == 'M' && grid[row][col] == 'A')
-  );
+// Function to get the 64 centers of a word where an X-MAS pattern is found, rowOf(letter, rowOffset) giving the bitplane rows around the center
+template <typename RowOf>
+inline uint64_t xmasMatchesAround(RowOf rowOf, int words, int word) {
+  auto cells = [&](char letter, int rowOffset, int colOffset) {
+    return shiftedWord(rowOf(letter, rowOffset), words, word, colOffset);
+  };
+
+  // Both diagonals through the center must read MAS in either direction
+  uint64_t mainDiagonal = (cells('M', -1, -1) & cells('S', 1, 1)) | (cells('S', -1, -1) & cells('M', 1, 1));
+  uint64_t antiDiagonal = (cells('M', -1, 1) & cells('S', 1, -1)) | (cells('S', -1, 1) & cells('M', 1, -1));
+  return cells('A', 0, 0) & mainDiagonal & antiDiagonal;
 }
 
-// Function to find all X-MAS patterns in the grid
-int findAllXMASPatterns(const std::vector<std::string>& grid, std::vector<std::string>& highlightedGrid) {
-  int rows = grid.size();
-  int cols = grid[0].size();
-  int count = 0;
+// Function to get the 64 centers of a word of a row where an X-MAS pattern is found
+inline uint64_t xmasMatches(const GridBitplanes& bitplanes, int row, int word) {
+  auto rowOf = [&](char letter, int rowOffset) { return bitplanes.row(letter, row + rowOffset); };
+  return xmasMatchesAround(rowOf, bitplanes.words, word);
+}
 
-  // Initialize highlighted grid with dots
-  highlightedGrid = std::vector<std::string>(rows, std::string(cols, '.'));
+// Function to find all X-MAS patterns in the grid, 64 centers at a time (highlighting only if highlightedGrid is given)
+long long findAllXMASPatterns(const std::vector<std::string>& grid, const GridBitplanes& bitplanes, unsigned threads,
+                              std::vector<std::string>* highlightedGrid) {
+  // Cells outside the grid are 0 in every bitplane, so border columns never match
+  return searchInBands(grid, 1, bitplanes.rows - 1, bitplanes.cols, threads, highlightedGrid, [&](int begin, int end, BandHighlights* highlights) {
+    long long count = 0;
+    for (int row = begin; row < end; ++row) {
+      for (int word = 0; word < bitplanes.words; ++word) {
+        uint64_t matches = xmasMatches(bitplanes, row, word);
+        count += __builtin_popcountll(matches);
+        if (highlights == nullptr) { continue; }
 
-  for (int row = 0; row < rows; ++row) {
-    for (int col = 0; col < cols; ++col) {
-      if (row == 0 || row == rows - 1 || col == 0 || col == cols - 1) { continue; }
-      else if (isXMASPattern(grid, row, col)) {
-        count++;
         // Highlight the X-MAS pattern
-        highlightedGrid[row][col] = grid[row][col];
-        highlightedGrid[row - 1][col - 1] = grid[row - 1][col - 1];
-        highlightedGrid[row + 1][col + 1] = grid[row + 1][col + 1];
-        highlightedGrid[row - 1][col + 1] = grid[row - 1][col + 1];
-        highlightedGrid[row + 1][col - 1] = grid[row + 1][col - 1];
+        for (; matches != 0; matches &= matches - 1) {
+          int col = word * 64 + __builtin_ctzll(matches);
+          highlights->mark(grid, row, col);
+          highlights->mark(grid, row - 1, col - 1);
+          highlights->mark(grid, row + 1, col + 1);
+          highlights->mark(grid, row - 1, col + 1);
+          highlights->mark(grid, row + 1, col - 1);
+        }
       }
     }
+    return count;
+  });
+}
+
+// Sliding window over a streamed grid: only the last WORD.size() rows are kept, encoded as bitplanes,
+// and every match is counted as soon as its last row arrives
+class StreamingSearch {
+ public:
+  StreamingSearch() : window(WORD.size(), std::vector<std::vector<uint64_t>>(BITPLANE_LETTERS.size())) {}
+
+  void addRow(const std::string& line) {
+    const int length = WORD.size();
+    const long long row = rowCount++;
+
+    // Rows longer than the previous ones widen the whole window
+    int lineWords = (static_cast<int>(line.size()) + 63) / 64;
+    if (lineWords > words) {
+      words = lineWords;
+      for (auto& planes : window) {
+        for (auto& plane : planes) { plane.resize(words, 0); }
+      }
+    }
+
+    // Encode the row into the slot of the oldest one
+    auto& planes = window[row % length];
+    for (auto& plane : planes) { std::fill(plane.begin(), plane.end(), 0); }
+    for (int col = 0; col < static_cast<int>(line.size()); ++col) {
+      size_t letter = BITPLANE_LETTERS.find(line[col]);
+      if (letter != std::string::npos) { planes[letter][col / 64] |= uint64_t(1) << (col % 64); }
+    }
+
+    // Words ending in this row: horizontal ones, and the vertical and diagonal ones spanning the window
+    std::vector<const uint64_t*> letterRows(length);
+    for (const auto& dir : DIRECTIONS) {
+      if (dir.first != 0 && row < length - 1) { continue; }
+      // Downward words start in the oldest row of the window, upward ones in this row
+      long long firstRow = dir.first > 0 ? row - (length - 1) : row;
+      for (int i = 0; i < length; ++i) { letterRows[i] = rowOf(WORD[i], firstRow + i * dir.first); }
+      for (int word = 0; word < words; ++word) {
+        xmasCount += __builtin_popcountll(wordMatches(letterRows.data(), words, word, dir.second));
+      }
+    }
+
+    // X-MAS patterns centered in the previous row
+    if (row >= 2) {
+      auto around = [&](char letter, int rowOffset) { return rowOf(letter, row - 1 + rowOffset); };
+      for (int word = 0; word < words; ++word) { xmasPatternCount += __builtin_popcountll(xmasMatchesAround(around, words, word)); }
+    }
   }
 
-  return count;
+  long long rows() const { return rowCount; }
+  long long xmasOccurrences() const { return xmasCount; }
+  long long xmasPatterns() const { return xmasPatternCount; }
+
+ private:
+  std::vector<std::vector<std::vector<uint64_t>>> window; // Row slot, letter, word
+  int words = 0;
+  long long rowCount = 0;
+  long long xmasCount = 0;
+  long long xmasPatternCount = 0;
+
+  // Bitplane row of a letter, for one of the rows in the window
+  const uint64_t* rowOf(char letter, long long row) const {
+    return window[row % WORD.size()][BITPLANE_LETTERS.find(letter)].data();
+  }
+};
+
+// Small 2D pattern of equally long rows, '.' matching any cell
+using Stencil = std::vector<std::string>;
+
+const char WILDCARD = '.';
+
+// Function to rotate a stencil a quarter turn clockwise
+Stencil rotateStencil(const Stencil& stencil) {
+  const int height = stencil.size();
+  const int width = stencil[0].size();
+  Stencil rotated(width, std::string(height, WILDCARD));
+  for (int row = 0; row < width; ++row) {
+    for (int col = 0; col < height; ++col) { rotated[row][col] = stencil[height - 1 - col][row]; }
+  }
+  return rotated;
 }
 
+// Function to mirror a stencil left to right
+Stencil reflectStencil(Stencil stencil) {
+  for (auto& row : stencil) { std::reverse(row.begin(), row.end()); }
+  return stencil;
+}
+
+// Aho-Corasick automaton over a word list, counting the occurrences of every word in the lines it scans
+class WordAutomaton {
+ public:
+  explicit WordAutomaton(const std::vector<std::string>& words) {
+    // Only the letters of the words get a column in the goto table, every other byte is symbol 0
+    symbolOf.fill(0);
+    for (const auto& word : words) {
+      for (unsigned char letter : word) {
+        if (symbolOf[letter] == 0) { symbolOf[letter] = ++symbolCount; }
+      }
+    }
+    symbolCount++;
+
+    // Build the trie of the words
+    addNode();
+    for (const auto& word : words) {
+      int node = 0;
+      for (unsigned char letter : word) {
+        // addNode grows the goto table, so the child is looked up by index
+        size_t child = static_cast<size_t>(node) * symbolCount + symbolOf[letter];
+        if (next[child] == 0) {
+          int created = addNode();
+          next[child] = created;
+        }
+        node = next[child];
+      }
+      wordNodes.push_back(node);
+    }
+
+    // Turn the trie into the automaton in BFS order: missing transitions follow the failure links
+    order.push_back(0);
+    for (size_t head = 0; head < order.size(); ++head) {
+      int node = order[head];
+      for (int symbol = 1; symbol < symbolCount; ++symbol) {
+        int& child = next[node * symbolCount + symbol];
+        int fallback = node == 0 ? 0 : next[failLink[node] * symbolCount + symbol];
+        if (child != 0) {
+          failLink[child] = fallback;
+          order.push_back(child);
+        } else {
+          child = fallback;
+        }
+      }
+    }
+  }
+
+  // Scan a line, forwards or backwards, counting the visits of every node
+  void scan(const std::string& line, bool reversed) {
+    int node = 0;
+    for (size_t i = 0; i < line.size(); ++i) {
+      unsigned char letter = reversed ? line[line.size() - 1 - i] : line[i];
+      node = next[node * symbolCount + symbolOf[letter]];
+      visits[node]++;
+    }
+  }
+
+  // Node reached from a node by reading a letter
+  int step(int node, unsigned char letter) const { return next[node * symbolCount + symbolOf[letter]]; }
+
+  int nodeCount() const { return visits.size(); }
+  int wordNode(size_t word) const { return wordNodes[word]; }
+  int failureLink(int node) const { return failLink[node]; }
+  const std::vector<int>& bfsOrder() const { return order; }
+
+  // Occurrences of every word, in the order of the word list
+  std::vector<long long> wordCounts() const {
+    // A visit of a node is an occurrence of every word along its failure links: push the counts down in reverse BFS order
+    std::vector<long long> occurrences = visits;
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+      if (*it != 0) { occurrences[failLink[*it]] += occurrences[*it]; }
+    }
+
+    std::vector<long long> counts;
+    for (int node : wordNodes) { counts.push_back(occurrences[node]); }
+    return counts;
+  }
+
+ private:
+  std::array<int, 256> symbolOf;
+  int symbolCount = 0;
+  std::vector<int> next;         // Goto table, nodeCount * symbolCount
+  std::vector<int> failLink;
+  std::vector<long long> visits;
+  std::vector<int> order;        // Nodes in BFS order
+  std::vector<int> wordNodes;    // Final node of every word
+
+  int addNode() {
+    next.resize(next.size() + symbolCount, 0);
+    failLink.push_back(0);
+    visits.push_back(0);
+    return nodeCount() - 1;
+  }
+};
+
+// Function to count every word of a list along every row, column and diagonal of the grid, in both directions
+std::vector<long long> countWords(const std::vector<std::string>& grid, const std::vector<std::string>& words) {
+  WordAutomaton automaton(words);
+  const int rows = grid.size();
+  int cols = 0;
+  for (const auto& row : grid) { cols = std::max<int>(cols, row.size()); }
+
+  // Cells missing from shorter rows never match a letter
+  auto cell = [&](int row, int col) { return col < static_cast<int>(grid[row].size()) ? grid[row][col] : '\0'; };
+  auto scanBothWays = [&](const std::string& line) {
+    automaton.scan(line, false);
+    automaton.scan(line, true);
+  };
+
+  std::string line;
+  // Rows and columns
+  for (int row = 0; row < rows; ++row) { scanBothWays(grid[row]); }
+  for (int col = 0; col < cols; ++col) {
+    line.clear();
+    for (int row = 0; row < rows; ++row) { line += cell(row, col); }
+    scanBothWays(line);
+  }
+
+  // Diagonals (down-right) and anti-diagonals (down-left), one per starting cell on the top row or a side column
+  for (int start = -(rows - 1); start < cols; ++start) {
+    line.clear();
+    for (int row = std::max(0, -start); row < rows && row + start < cols; ++row) { line += cell(row, row + start); }
+    scanBothWays(line);
+  }
+  for (int start = 0; start < rows + cols - 1; ++start) {
+    line.clear();
+    for (int row = std::max(0, start - cols + 1); row < rows && start - row >= 0; ++row) { line += cell(row, start - row); }
+    scanBothWays(line);
+  }
+
+  return automaton.wordCounts();
+}
+
+// Matcher of a set of stencils, with all their rotations and reflections.
+// Every orientation is anchored on its longest run of letters: an Aho-Corasick automaton over the anchors reads
+// every row once, and each anchor found is checked against the rest of its orientation. Building the matcher is
+// linear in the size of the stencils, and a cell costs more than one table lookup only where an anchor ends
+class StencilMatcher {
+ public:
+  explicit StencilMatcher(const std::vector<Stencil>& stencils)
+      : stencilCount(stencils.size()), anchors(std::vector<std::string>()) {
+    // Distinct orientations, each credited to every stencil that has it (a stencil only once)
+    std::map<Stencil, int> variantOf;
+    for (int stencil = 0; stencil < stencilCount; ++stencil) {
+      Stencil variant = stencils[stencil];
+      for (int turn = 0; turn < 8; ++turn) {
+        auto [it, inserted] = variantOf.emplace(variant, variants.size());
+        if (inserted) {
+          variants.push_back(variant);
+          stencilsOf.emplace_back();
+        }
+        if (stencilsOf[it->second].empty() || stencilsOf[it->second].back() != stencil) { stencilsOf[it->second].push_back(stencil); }
+        variant = turn == 3 ? reflectStencil(variant) : rotateStencil(variant);
+      }
+    }
+
+    // Anchor of every variant: its longest run of letters without a wildcard
+    std::vector<std::string> anchorWords;
+    for (int variant = 0; variant < static_cast<int>(variants.size()); ++variant) {
+      Anchor anchor;
+      const Stencil& stencil = variants[variant];
+      for (int row = 0; row < static_cast<int>(stencil.size()); ++row) {
+        for (int col = 0; col < static_cast<int>(stencil[row].size());) {
+          int length = 0;
+          while (col + length < static_cast<int>(stencil[row].size()) && stencil[row][col + length] != WILDCARD) { length++; }
+          if (length > anchor.length) { anchor = {variant, row, col, length}; }
+          col += std::max(length, 1);
+        }
+      }
+
+      // A stencil of wildcards only matches wherever it fits
+      if (anchor.length == 0) { wildcardVariants.push_back(variant); }
+      else {
+        variantAnchors.push_back(anchor);
+        anchorWords.push_back(stencil[anchor.row].substr(anchor.col, anchor.length));
+      }
+    }
+
+    anchors = WordAutomaton(anchorWords);
+    anchorsAt.assign(anchors.nodeCount(), {});
+    for (size_t anchor = 0; anchor < variantAnchors.size(); ++anchor) { anchorsAt[anchors.wordNode(anchor)].push_back(anchor); }
+
+    // Output links: the nearest node along the failure links where anchors end, 0 if none
+    outputLink.assign(anchors.nodeCount(), 0);
+    for (int node : anchors.bfsOrder()) {
+      if (node == 0) { continue; }
+      int fallback = anchors.failureLink(node);
+      outputLink[node] = anchorsAt[fallback].empty() ? outputLink[fallback] : fallback;
+    }
+  }
+
+  // Occurrences of every stencil in the grid, in any orientation (highlighting only if highlightedGrid is given)
+  std::vector<long long> countMatches(const std::vector<std::string>& grid, std::vector<std::string>* highlightedGrid) const {
+    const int rows = grid.size();
+    int cols = 0;
+    for (const auto& row : grid) { cols = std::max<int>(cols, row.size()); }
+    if (highlightedGrid != nullptr) { *highlightedGrid = std::vector<std::string>(rows, std::string(cols, '.')); }
+
+    std::vector<long long> counts(stencilCount, 0);
+    for (int variant : wildcardVariants) {
+      const long long fits = std::max(0LL, rows - static_cast<long long>(variants[variant].size()) + 1) *
+                             std::max(0LL, cols - static_cast<long long>(variants[variant][0].size()) + 1);
+      for (int stencil : stencilsOf[variant]) { counts[stencil] += fits; }
+    }
+
+    for (int row = 0; row < rows; ++row) {
+      const std::string& line = grid[row];
+      int node = 0;
+      for (int col = 0; col < cols; ++col) {
+        // Cells missing from shorter rows never match a letter
+        node = anchors.step(node, col < static_cast<int>(line.size()) ? line[col] : '\0');
+        for (int hit = anchorsAt[node].empty() ? outputLink[node] : node; hit != 0; hit = outputLink[hit]) {
+          for (int anchor : anchorsAt[hit]) {
+            const Anchor& found = variantAnchors[anchor];
+            const int top = row - found.row;
+            const int left = col - found.length + 1 - found.col;
+            if (!matchesAt(grid, found.variant, top, left, rows, cols)) { continue; }
+
+            for (int stencil : stencilsOf[found.variant]) { counts[stencil]++; }
+            if (highlightedGrid != nullptr) { highlightVariant(grid, found.variant, top, left, *highlightedGrid); }
+          }
+        }
+      }
+    }
+    return counts;
+  }
+
+ private:
+  // Longest run of letters of a variant, starting at stencil[row][col]
+  struct Anchor {
+    int variant = 0, row = 0, col = 0, length = 0;
+  };
+
+  int stencilCount;
+  std::vector<Stencil> variants;                 // Distinct orientations of the stencils
+  std::vector<std::vector<int>> stencilsOf;      // Stencils of every variant, in ascending order
+  std::vector<Anchor> variantAnchors;            // Anchor of every variant with a letter, in the word order of the automaton
+  std::vector<int> wildcardVariants;             // Variants made of wildcards only
+  WordAutomaton anchors;
+  std::vector<std::vector<int>> anchorsAt;       // Anchors ending exactly at every node of the automaton
+  std::vector<int> outputLink;
+
+  // Check if a variant whose top-left corner is at grid[top][left] fits in the grid and matches it
+  bool matchesAt(const std::vector<std::string>& grid, int variant, int top, int left, int rows, int cols) const {
+    const Stencil& stencil = variants[variant];
+    if (top < 0 || left < 0 || top + static_cast<int>(stencil.size()) > rows || left + static_cast<int>(stencil[0].size()) > cols) { return false; }
+    for (int i = 0; i < static_cast<int>(stencil.size()); ++i) {
+      const std::string& line = grid[top + i];
+      for (int j = 0; j < static_cast<int>(stencil[i].size()); ++j) {
+        if (stencil[i][j] == WILDCARD) { continue; }
+        if (left + j >= static_cast<int>(line.size()) || line[left + j] != stencil[i][j]) { return false; }
+      }
+    }
+    return true;
+  }
+
+  // Highlight the letters of a variant whose top-left corner is at grid[top][left]
+  void highlightVariant(const std::vector<std::string>& grid, int variant, int top, int left, std::vector<std::string>& highlightedGrid) const {
+    const Stencil& stencil = variants[variant];
+    for (int i = 0; i < static_cast<int>(stencil.size()); ++i) {
+      for (int j = 0; j < static_cast<int>(stencil[i].size()); ++j) {
+        if (stencil[i][j] != WILDCARD) { highlightedGrid[top + i][left + j] = grid[top + i][left + j]; }
+      }
+    }
+  }
+};
+
 int main(int argc, char* argv[]) {
   // Check if the input file is provided
   if (argc < 2) {
-    std::cerr << "Usage: " << argv[0] << " <input_file> [-trace]" << std::endl;
+    std::cerr << "Usage: " << argv[0] << " <input_file | -> [-trace] [-threads <n>] [-words <word_list_file>] [-stencils <stencil_file>] [-stream]" << std::endl;
     return EXIT_FAILURE;
   }
 
-  // Check if the -trace option is provided
+  // Check if the -trace, -threads, -words, -stencils and -stream options are provided
   bool trace = false;
-  if (argc > 2 && std::string(argv[2]) == "-trace") { trace = true; }
+  bool stream = false;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string wordsFilename;
+  std::string stencilsFilename;
+  for (int i = 2; i < argc; ++i) {
+    std::string option = argv[i];
+    if (option == "-trace") { trace = true; }
+    else if (i + 1 < argc && option == "-threads") { threads = std::max(1, std::atoi(argv[++i])); }
+    else if (i + 1 < argc && option == "-words") { wordsFilename = argv[++i]; }
+    else if (i + 1 < argc && option == "-stencils") { stencilsFilename = argv[++i]; }
+    else if (option == "-stream") { stream = true; }
+    else {
+      std::cerr << "Error: Unknown option " << option << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
 
-  // Open the input file
-  std::ifstream inputFile(argv[1]);
-  if (!inputFile) {
-    std::cerr << "Error: Could not open file " << argv[1] << std::endl;
-    return EXIT_FAILURE;
+  // Open the input file, or read the standard input ("-")
+  const std::string filename = argv[1];
+  std::ifstream inputFile;
+  if (filename != "-") {
+    inputFile.open(filename);
+    if (!inputFile) {
+      std::cerr << "Error: Could not open file " << filename << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  std::istream& input = filename == "-" ? std::cin : inputFile;
+  std::string line;
+
+  // Streaming mode: only the last WORD.size() rows are kept in memory, so the grid can be read from a pipe
+  if (stream) {
+    if (trace || !wordsFilename.empty() || !stencilsFilename.empty()) {
+      std::cerr << "Error: -trace, -words and -stencils need the whole grid, they cannot be used with -stream" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::ios::sync_with_stdio(false);
+    StreamingSearch search;
+    while (std::getline(input, line)) { search.addRow(line); }
+    if (search.rows() == 0) {
+      std::cerr << "Error: Input file is empty or invalid." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::cout << "Total occurrences of 'XMAS': " << search.xmasOccurrences() << std::endl;
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Total occurrences of 'X-MAS': " << search.xmasPatterns() << std::endl;
+    return EXIT_SUCCESS;
   }
 
   std::vector<std::string> grid;
 
   // Read the grid from the file
-  std::string line;
-  while (std::getline(inputFile, line)) { grid.push_back(line); }
+  while (std::getline(input, line)) { grid.push_back(line); }
   inputFile.close();
 
   // Check if the grid is empty
@@ -143,11 +648,73 @@ int main(int argc, char* argv[]) {
     return EXIT_FAILURE;
   }
 
-  // Grid to store the highlighted occurrences
+  // Word list mode: count every word of the list in a single pass per line
+  if (!wordsFilename.empty()) {
+    std::ifstream wordsFile(wordsFilename);
+    if (!wordsFile) {
+      std::cerr << "Error: Could not open file " << wordsFilename << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> words;
+    while (std::getline(wordsFile, line)) {
+      if (!line.empty()) { words.push_back(line); }
+    }
+    wordsFile.close();
+
+    std::vector<long long> counts = countWords(grid, words);
+    for (size_t i = 0; i < words.size(); ++i) {
+      std::cout << "Total occurrences of '" << words[i] << "': " << counts[i] << std::endl;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // Grid to store the highlighted occurrences, only filled in when tracing
   std::vector<std::string> highlightedGrid;
+  std::vector<std::string>* highlights = trace ? &highlightedGrid : nullptr;
+
+  // Stencil mode: stencils separated by blank lines, each matched in all its rotations and reflections
+  if (!stencilsFilename.empty()) {
+    std::ifstream stencilsFile(stencilsFilename);
+    if (!stencilsFile) {
+      std::cerr << "Error: Could not open file " << stencilsFilename << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::vector<Stencil> stencils(1);
+    while (std::getline(stencilsFile, line)) {
+      if (!line.empty()) { stencils.back().push_back(line); }
+      else if (!stencils.back().empty()) { stencils.emplace_back(); }
+    }
+    stencilsFile.close();
+    if (stencils.back().empty()) { stencils.pop_back(); }
+    if (stencils.empty()) {
+      std::cerr << "Error: Stencil file is empty or invalid." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Shorter rows are padded with wildcards
+    for (auto& stencil : stencils) {
+      size_t width = 0;
+      for (const auto& row : stencil) { width = std::max(width, row.size()); }
+      for (auto& row : stencil) { row.resize(width, WILDCARD); }
+    }
+
+    std::vector<long long> counts = StencilMatcher(stencils).countMatches(grid, highlights);
+    for (size_t i = 0; i < stencils.size(); ++i) {
+      std::cout << "Total occurrences of stencil " << i + 1 << ": " << counts[i] << std::endl;
+    }
+    if (trace) {
+      std::cout << std::endl << "Highlighted Grid:" << std::endl;
+      for (const auto& row : highlightedGrid) { std::cout << row << std::endl; }
+    }
+    return EXIT_SUCCESS;
+  }
+
+  GridBitplanes bitplanes = buildBitplanes(grid);
 
   // Phase 1: Find all occurrences of "XMAS"
-  int count = findAllOccurrences(grid, highlightedGrid);
+  long long count = findAllOccurrences(grid, bitplanes, threads, highlights);
   std::cout << "Total occurrences of 'XMAS': " << count << std::endl;
   if (trace) {
     std::cout << std::endl << "Highlighted Grid:" << std::endl;
@@ -159,7 +726,7 @@ int main(int argc, char* argv[]) {
   if (trace) { std::cout << std::endl; }
 
   // Phase 2: Find all X-MAS patterns
-  count = findAllXMASPatterns(grid, highlightedGrid);
+  count = findAllXMASPatterns(grid, bitplanes, threads, highlights);
   std::cout << "Total occurrences of 'X-MAS': " << count << std::endl;
   if (trace) {
     std::cout << std::endl << "Highlighted Grid:" << std::endl;
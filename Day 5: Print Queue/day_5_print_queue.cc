@@ -15,7 +15,8 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <algorithm>
-#include <queue>
+#include <cstdint>
+#include <thread>
 
 using namespace std;
 
@@ -30,156 +31,453 @@ unordered_map<int, unordered_set<int>> parseOrderingRules(const vector<string>&
   return ordering;
 }
 
-// Function to check if a given update is in the correct order
-bool isUpdateCorrect(const vector<int>& update, const unordered_map<int, unordered_set<int>>& ordering) {
-  unordered_map<int, int> index;
-  for (size_t i = 0; i < update.size(); ++i) { index[update[i]] = i; }
-  for (const auto& [x, ys] : ordering) {
-    if (index.find(x) == index.end()) continue; // Skip if x is not in the update
-    for (int y : ys) {
-      if (index.find(y) == index.end()) { continue; } // Skip if y is not in the update
-      if (index[x] > index[y]) { return false; }      // x must appear before y
+// Ordering rules compiled into a dense page x page bit matrix: bit y of row x is set if page x must be printed before page y
+class PrecedenceMatrix {
+ public:
+  explicit PrecedenceMatrix(const unordered_map<int, unordered_set<int>>& ordering) {
+    // Every page named by a rule gets a dense index
+    for (const auto& [x, ys] : ordering) {
+      addPage(x);
+      for (int y : ys) { addPage(y); }
+    }
+    words = (pageCount + 63) / 64;
+    bits.assign(static_cast<size_t>(pageCount) * words, 0);
+    for (const auto& [x, ys] : ordering) {
+      for (int y : ys) { setBit(indexOf(x), indexOf(y)); }
     }
   }
-  return true;
+
+  // Dense index of a page, -1 if no rule names it
+  int indexOf(int page) const {
+    auto it = pageIndex.find(page);
+    return it == pageIndex.end() ? -1 : it->second;
+  }
+
+  // Check if a rule says the page with index x must be printed before the page with index y
+  bool mustPrecede(int x, int y) const {
+    if (x < 0 || y < 0) { return false; }
+    return (bits[static_cast<size_t>(x) * words + y / 64] >> (y % 64)) & 1;
+  }
+
+ private:
+  unordered_map<int, int> pageIndex;
+  int pageCount = 0;
+  int words = 0;
+  vector<uint64_t> bits;
+
+  void addPage(int page) {
+    if (pageIndex.emplace(page, pageCount).second) { pageCount++; }
+  }
+
+  void setBit(int x, int y) { bits[static_cast<size_t>(x) * words + y / 64] |= uint64_t(1) << (y % 64); }
+};
+
+// Buffers reused from one update to the next
+struct UpdateScratch {
+  vector<int> indices;  // Dense index of every page
+  vector<int> inDegree; // Pages of the update that must be printed before every page
+  vector<int> order;    // Positions of the pages once in order
+};
+
+// Classification of an update, with its middle page once in order
+struct UpdateClass {
+  bool correct = true;   // Already in order
+  bool orderable = true; // The rules between its pages have no cycle
+  int middlePage = 0;
+};
+
+// Function to classify an update and select its middle page in a single pass over its pairs of pages.
+// When it is not in order, scratch.order holds the positions of its pages in the reordered update
+UpdateClass classifyUpdate(const vector<int>& update, const PrecedenceMatrix& precedence, UpdateScratch& scratch) {
+  const int k = update.size();
+  UpdateClass result;
+  scratch.indices.clear();
+  for (int page : update) { scratch.indices.push_back(precedence.indexOf(page)); }
+  scratch.inDegree.assign(k, 0);
+
+  // Count the predecessors of every page, noting the pairs printed in the wrong order and the pairs no rule covers
+  bool total = true;
+  for (int j = 1; j < k; ++j) {
+    for (int i = 0; i < j; ++i) {
+      bool forward = precedence.mustPrecede(scratch.indices[i], scratch.indices[j]);
+      bool backward = precedence.mustPrecede(scratch.indices[j], scratch.indices[i]);
+
+      // Rules in both directions break any order of the update: a cycle of two pages
+      if (forward && backward) {
+        result.correct = false;
+        result.orderable = false;
+        return result;
+      }
+
+      // From here on a pair has at most one rule, so both the ranks and Kahn's in-degrees count one edge per pair
+      if (forward) { scratch.inDegree[j]++; }
+      else if (backward) {
+        scratch.inDegree[i]++;
+        result.correct = false;
+      } else { total = false; }
+    }
+  }
+  if (result.correct) {
+    result.middlePage = update[k / 2];
+    return result;
+  }
+
+  scratch.order.assign(k, -1);
+  if (total) {
+    // Rules between every pair: without a cycle, the number of predecessors of a page is its position once in order,
+    // so the middle page is selected directly. Two pages with the same count mean a cycle
+    for (int j = 0; j < k; ++j) {
+      if (scratch.order[scratch.inDegree[j]] != -1) {
+        result.orderable = false;
+        return result;
+      }
+      scratch.order[scratch.inDegree[j]] = j;
+    }
+  } else {
+    // Some pairs are free: Kahn's algorithm over the positions, with the matrix as the graph
+    int head = 0, tail = 0;
+    for (int j = 0; j < k; ++j) {
+      if (scratch.inDegree[j] == 0) { scratch.order[tail++] = j; }
+    }
+    while (head < tail) {
+      int current = scratch.order[head++];
+      for (int j = 0; j < k; ++j) {
+        if (precedence.mustPrecede(scratch.indices[current], scratch.indices[j]) && --scratch.inDegree[j] == 0) { scratch.order[tail++] = j; }
+      }
+    }
+
+    // If not all the pages could be ordered, there is a cycle
+    if (tail != k) {
+      result.orderable = false;
+      return result;
+    }
+  }
+
+  result.middlePage = update[scratch.order[k / 2]];
+  return result;
 }
 
-vector<int> reorderUpdate(const vector<int>& update, const unordered_map<int, unordered_set<int>>& ordering) {
-  // Crear un grafo dirigido y un mapa de in-degrees
-  unordered_map<int, int> inDegree;
-  unordered_map<int, vector<int>> graph;
-  
-  // Inicializar nodos del grafo para las páginas del update
-  for (int page : update) {
-    inDegree[page] = 0;
-    graph[page] = {};
-  }
-
-  // Construir el grafo solo con las páginas en el update
-  for (int page : update) {
-    if (ordering.count(page)) {
-      for (int dependent : ordering.at(page)) {
-        if (find(update.begin(), update.end(), dependent) != update.end()) {
-          graph[page].push_back(dependent);
-          inDegree[dependent]++;
+// Ordering rules kept as a live graph with a topological order maintained on every insertion (Pearce-Kelly).
+// A page with a lower rank is never required to be printed after one with a higher rank, so update checks are rank comparisons
+class LiveOrdering {
+ public:
+  // Insert the rule x|y, returning false (and leaving the rules unchanged) if it would close a cycle
+  bool addRule(int x, int y) {
+    if (x == y) { return false; }
+    int from = addPage(x), to = addPage(y);
+    if (edges.count(edgeKey(from, to))) { return true; }
+
+    // Only an edge against the current order needs work: the pages between both ranks reachable from y,
+    // and the ones reaching x, are moved so that the second group comes first
+    const int lowerBound = rank[to], upperBound = rank[from];
+    if (lowerBound < upperBound) {
+      forwardRegion.clear();
+      backwardRegion.clear();
+      bool cycle = !collectForward(to, upperBound, from);
+      if (!cycle) { collectBackward(from, lowerBound); }
+      for (int page : forwardRegion) { visited[page] = false; }
+      for (int page : backwardRegion) { visited[page] = false; }
+      if (cycle) { return false; }
+      reorder();
+    }
+
+    edges.insert(edgeKey(from, to));
+    successors[from].push_back(to);
+    predecessors[to].push_back(from);
+    return true;
+  }
+
+  // Rank of a page in the maintained order, -1 if no rule names it
+  int rankOf(int page) const {
+    auto it = pageIndex.find(page);
+    return it == pageIndex.end() ? -1 : rank[it->second];
+  }
+
+  // Check if the rule x|y was inserted
+  bool hasRule(int x, int y) const {
+    auto from = pageIndex.find(x), to = pageIndex.find(y);
+    return from != pageIndex.end() && to != pageIndex.end() && edges.count(edgeKey(from->second, to->second));
+  }
+
+ private:
+  unordered_map<int, int> pageIndex;
+  vector<int> rank; // Rank of every page index
+  vector<vector<int>> successors, predecessors;
+  unordered_set<uint64_t> edges;
+  vector<bool> visited;
+  vector<int> forwardRegion, backwardRegion;
+
+  static uint64_t edgeKey(int from, int to) { return (static_cast<uint64_t>(from) << 32) | static_cast<uint32_t>(to); }
+
+  // New pages are ranked after all the others
+  int addPage(int page) {
+    auto [it, inserted] = pageIndex.emplace(page, rank.size());
+    if (inserted) {
+      rank.push_back(rank.size());
+      successors.emplace_back();
+      predecessors.emplace_back();
+      visited.push_back(false);
+    }
+    return it->second;
+  }
+
+  // Pages reachable from start with a rank up to upperBound, false if target is reached (a cycle)
+  bool collectForward(int start, int upperBound, int target) {
+    vector<int> stack = {start};
+    visited[start] = true;
+    forwardRegion.push_back(start);
+    while (!stack.empty()) {
+      int page = stack.back();
+      stack.pop_back();
+      for (int next : successors[page]) {
+        if (next == target) { return false; }
+        if (!visited[next] && rank[next] < upperBound) {
+          visited[next] = true;
+          forwardRegion.push_back(next);
+          stack.push_back(next);
         }
       }
     }
+    return true;
   }
 
-  // Ordenamiento topológico usando Kahn's Algorithm
-  queue<int> q;
-  vector<int> sortedUpdate;
+  // Pages reaching start with a rank from lowerBound on
+  void collectBackward(int start, int lowerBound) {
+    vector<int> stack = {start};
+    visited[start] = true;
+    backwardRegion.push_back(start);
+    while (!stack.empty()) {
+      int page = stack.back();
+      stack.pop_back();
+      for (int previous : predecessors[page]) {
+        if (!visited[previous] && rank[previous] > lowerBound) {
+          visited[previous] = true;
+          backwardRegion.push_back(previous);
+          stack.push_back(previous);
+        }
+      }
+    }
+  }
 
-  // Agregar nodos con in-degree 0 a la cola
-  for (const auto& [page, degree] : inDegree) {
-    if (degree == 0) { q.push(page); }
+  // Give the ranks of both regions back to their pages, the backward region first, each keeping its relative order
+  void reorder() {
+    auto byRank = [&](int a, int b) { return rank[a] < rank[b]; };
+    sort(forwardRegion.begin(), forwardRegion.end(), byRank);
+    sort(backwardRegion.begin(), backwardRegion.end(), byRank);
+
+    vector<int> pages = backwardRegion;
+    pages.insert(pages.end(), forwardRegion.begin(), forwardRegion.end());
+    vector<int> ranks;
+    for (int page : pages) { ranks.push_back(rank[page]); }
+    sort(ranks.begin(), ranks.end());
+
+    for (size_t i = 0; i < pages.size(); ++i) { rank[pages[i]] = ranks[i]; }
   }
+};
 
-  while (!q.empty()) {
-    int current = q.front();
-    q.pop();
-    sortedUpdate.push_back(current);
+// Function to check an update against the live rules: only pairs of pages whose ranks are inverted can break a rule
+bool isUpdateCorrect(const vector<int>& update, const LiveOrdering& ordering) {
+  vector<int> ranks;
+  for (int page : update) { ranks.push_back(ordering.rankOf(page)); }
 
-    for (int neighbor : graph[current]) {
-      inDegree[neighbor]--;
-      if (inDegree[neighbor] == 0) { q.push(neighbor); }
+  for (size_t j = 1; j < update.size(); ++j) {
+    for (size_t i = 0; i < j; ++i) {
+      if (ranks[i] > ranks[j] && ranks[j] >= 0 && ordering.hasRule(update[j], update[i])) { return false; }
     }
   }
+  return true;
+}
 
-  // Si no se pudieron ordenar todas las páginas, hay un ciclo o inconsistencia
-  if (sortedUpdate.size() != update.size()) { return {}; }
+// Function to reorder an update by rank, which respects every live rule between its pages (pages without rules go first)
+vector<int> reorderUpdate(const vector<int>& update, const LiveOrdering& ordering) {
+  vector<pair<int, int>> ranked;
+  for (int page : update) { ranked.emplace_back(ordering.rankOf(page), page); }
+  sort(ranked.begin(), ranked.end());
 
+  vector<int> sortedUpdate;
+  for (const auto& [rank, page] : ranked) { sortedUpdate.push_back(page); }
   return sortedUpdate;
 }
 
+// Function to select the middle page of the update reordered by rank, without sorting it
+int reorderedMiddlePage(const vector<int>& update, const LiveOrdering& ordering) {
+  vector<pair<int, int>> ranked;
+  for (int page : update) { ranked.emplace_back(ordering.rankOf(page), page); }
+  nth_element(ranked.begin(), ranked.begin() + ranked.size() / 2, ranked.end());
+  return ranked[ranked.size() / 2].second;
+}
+
+// Function to parse an update, a comma-separated list of pages
+vector<int> parseUpdate(const string& line) {
+  stringstream ss(line);
+  vector<int> update;
+  int page;
+  while (ss >> page) {
+    update.push_back(page);
+    if (ss.peek() == ',') { ss.ignore(); }
+  }
+  return update;
+}
+
+// Fewest updates handed to a worker thread
+const size_t MIN_CHUNK_UPDATES = 1024;
+
+// Sums and trace lines of a chunk of updates
+struct ChunkResult {
+  long long sumOfMiddlePages = 0;
+  long long sumOfReorderedMiddlePages = 0;
+  ostringstream correctTrace;
+  ostringstream reorderedTrace;
+};
+
+// Function to classify the updates [begin, end) against the read-only precedence matrix
+void processUpdates(const vector<vector<int>>& updates, size_t begin, size_t end, const PrecedenceMatrix& precedence, bool trace,
+                    ChunkResult& chunk) {
+  UpdateScratch scratch;
+  for (size_t u = begin; u < end; ++u) {
+    const vector<int>& update = updates[u];
+    if (update.empty()) { continue; }
+    UpdateClass result = classifyUpdate(update, precedence, scratch);
+
+    // Phase 1: Updates in the correct order
+    if (result.correct) {
+      if (trace) {
+        chunk.correctTrace << "Correct update: ";
+        for (int page : update) chunk.correctTrace << page << " ";
+        chunk.correctTrace << endl;
+      }
+      chunk.sumOfMiddlePages += result.middlePage;
+      continue;
+    }
+
+    // Phase 2: Reordered updates, skipping the ones whose rules form a cycle
+    if (!result.orderable) { continue; }
+    if (trace) {
+      chunk.reorderedTrace << "Reordered update: ";
+      for (int position : scratch.order) chunk.reorderedTrace << update[position] << " ";
+      chunk.reorderedTrace << endl;
+    }
+    chunk.sumOfReorderedMiddlePages += result.middlePage;
+  }
+}
+
 // Main program logic
 int main(int argc, char* argv[]) {
   // Check if the input file is provided
   if (argc < 2) {
-    std::cerr << "Usage: " << argv[0] << " <input_file> [-trace]" << std::endl;
+    std::cerr << "Usage: " << argv[0] << " <input_file | -> [-trace] [-threads <n>] [-incremental]" << std::endl;
     return EXIT_FAILURE;
   }
 
-  // Check if the -trace option is provided
+  // Check if the -trace, -threads and -incremental options are provided
   bool trace = false;
-  if (argc > 2 && std::string(argv[2]) == "-trace") { trace = true; }
+  bool incremental = false;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 2; i < argc; ++i) {
+    std::string option = argv[i];
+    if (option == "-trace") { trace = true; }
+    else if (i + 1 < argc && option == "-threads") { threads = std::max(1, std::atoi(argv[++i])); }
+    else if (option == "-incremental") { incremental = true; }
+    else {
+      std::cerr << "Error: Unknown option " << option << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
 
-  ifstream inputFile(argv[1]);
-  if (!inputFile) {
-    cerr << "Error: Could not open file " << argv[1] << endl;
-    return EXIT_FAILURE;
+  // Open the input file, or read the standard input ("-")
+  const string filename = argv[1];
+  ifstream inputFile;
+  if (filename != "-") {
+    inputFile.open(filename);
+    if (!inputFile) {
+      cerr << "Error: Could not open file " << filename << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  istream& input = filename == "-" ? cin : inputFile;
+  string line;
+
+  // Incremental mode: rules and updates arrive interleaved, and every update is answered against the rules seen so far
+  if (incremental) {
+    LiveOrdering ordering;
+    long long sumOfMiddlePages = 0;
+    long long sumOfReorderedMiddlePages = 0;
+    while (getline(input, line)) {
+      if (line.empty()) { continue; }
+      if (line.find('|') != string::npos) {
+        int x, y;
+        if (sscanf(line.c_str(), "%d|%d", &x, &y) == 2 && !ordering.addRule(x, y)) {
+          cerr << "Skipping rule " << line << ": it closes a cycle." << endl;
+        }
+        continue;
+      }
+
+      vector<int> update = parseUpdate(line);
+      if (update.empty()) { continue; }
+      if (isUpdateCorrect(update, ordering)) {
+        if (trace) {
+          cout << "Correct update: ";
+          for (int page : update) cout << page << " ";
+          cout << endl;
+        }
+        sumOfMiddlePages += update[update.size() / 2];
+      } else if (trace) {
+        auto reorderedUpdate = reorderUpdate(update, ordering);
+        cout << "Reordered update: ";
+        for (int page : reorderedUpdate) cout << page << " ";
+        cout << endl;
+        sumOfReorderedMiddlePages += reorderedUpdate[reorderedUpdate.size() / 2];
+      } else {
+        sumOfReorderedMiddlePages += reorderedMiddlePage(update, ordering);
+      }
+    }
+
+    cout << "Sum of middle pages: " << sumOfMiddlePages << endl;
+    cout << "Sum of middle pages (reordered updates): " << sumOfReorderedMiddlePages << endl;
+    return EXIT_SUCCESS;
   }
 
   vector<string> rules;
   vector<vector<int>> updates;
-  string line;
 
   // Read ordering rules
-  while (getline(inputFile, line) && !line.empty()) { rules.push_back(line); }
+  while (getline(input, line) && !line.empty()) { rules.push_back(line); }
 
   // Read updates
-  while (getline(inputFile, line)) {
-    stringstream ss(line);
-    vector<int> update;
-    int page;
-    while (ss >> page) {
-      update.push_back(page);
-      if (ss.peek() == ',') { ss.ignore(); }
-    }
-    updates.push_back(update);
-  }
+  while (getline(input, line)) { updates.push_back(parseUpdate(line)); }
 
   inputFile.close();
 
-  // Parse ordering rules
+  // Parse ordering rules and compile them into the precedence matrix
   auto ordering = parseOrderingRules(rules);
+  PrecedenceMatrix precedence(ordering);
 
-  // Phase 1: Process updates and calculate the sum of middle pages
-  int sumOfMiddlePages = 0;
-  for (const auto& update : updates) {
-      if (isUpdateCorrect(update, ordering)) {
-        if (trace) {
-          cout << "Correct update: ";
-          for (int page : update) cout << page << " ";
-          cout << endl;
-        }
+  // Classify every update once, in parallel chunks sharing the frozen rules: correct ones count towards phase 1,
+  // the others are reordered for phase 2
+  threads = std::max<size_t>(1, std::min<size_t>(threads, updates.size() / MIN_CHUNK_UPDATES));
+  vector<ChunkResult> chunks(threads);
+  vector<thread> workers;
+  for (unsigned chunk = 0; chunk < threads; ++chunk) {
+    workers.emplace_back([&, chunk]() {
+      processUpdates(updates, updates.size() * chunk / threads, updates.size() * (chunk + 1) / threads, precedence, trace, chunks[chunk]);
+    });
+  }
+  for (thread& worker : workers) { worker.join(); }
 
-        // Find the middle page
-        int middlePage = update[update.size() / 2];
-        sumOfMiddlePages += middlePage;
-      }
+  // Merge the chunks in order, so the trace is the same whatever the number of threads
+  long long sumOfMiddlePages = 0;
+  long long sumOfReorderedMiddlePages = 0;
+  for (const auto& chunk : chunks) {
+    sumOfMiddlePages += chunk.sumOfMiddlePages;
+    sumOfReorderedMiddlePages += chunk.sumOfReorderedMiddlePages;
+    if (trace) { cout << chunk.correctTrace.str(); }
   }
 
   cout << "Sum of middle pages: " << sumOfMiddlePages << endl;
 
   if (trace) {
     cout << endl << "--------------------------------" << endl << endl;
-  }
-
-  // Phase 2: Process updates and calculate the sum of middle pages for reordered updates
-  int sumOfReorderedMiddlePages = 0;
-  for (const auto& update : updates) {
-      if (!isUpdateCorrect(update, ordering)) {
-        // Reordenar la actualización incorrecta
-        auto reorderedUpdate = reorderUpdate(update, ordering);
-        if (reorderedUpdate.empty()) { continue; }
-
-        if (trace) {
-          if (reorderedUpdate.empty()) {
-            cerr << "Skipping reorder due to inconsistency.\n";
-          }
-
-          // Imprimir la actualización reordenada
-          cout << "Reordered update: ";
-          for (int page : reorderedUpdate) cout << page << " ";
-          cout << endl;
-        }
-
-        // Encontrar la página central
-        int middlePage = reorderedUpdate[reorderedUpdate.size() / 2];
-        sumOfReorderedMiddlePages += middlePage;
-      }
+    for (const auto& chunk : chunks) { cout << chunk.reorderedTrace.str(); }
   }
 
   cout << "Sum of middle pages (reordered updates): " << sumOfReorderedMiddlePages << endl;
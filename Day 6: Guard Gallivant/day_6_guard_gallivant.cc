@@ -13,6 +13,11 @@
 #include <fstream>
 #include <string>
 #include <set>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <climits>
+#include <cstdlib>
 using namespace std;
 
 // Directions: {dx, dy} for Up, Right, Down, Left
@@ -65,75 +70,171 @@ int simulatePatrol(vector<string>& map) {
   return visited.size();
 }
 
-// Simulate the guard's patrol and check if it gets stuck in a loop
-bool simulateWithLoopCheck(vector<string>& map, const pair<int, int>& obstruction) {
+// Position and direction of the guard
+struct GuardState {
+  int row, col, direction;
+};
+
+// Cells of the original patrol route that can hold an obstruction, with the guard's state just before it first steps on each
+vector<pair<pair<int, int>, GuardState>> findPatrolCandidates(const vector<string>& map) {
   auto [position, direction] = findGuard(map);
   int rows = map.size();
   int cols = map[0].size();
+  vector<bool> visited(rows * cols, false);
+  vector<pair<pair<int, int>, GuardState>> candidates;
+  visited[position.first * cols + position.second] = true;
+
+  while (true) {
+    int nx = position.first + DIRECTIONS[direction].first;
+    int ny = position.second + DIRECTIONS[direction].second;
+    if (nx < 0 || nx >= rows || ny < 0 || ny >= cols) { break; }
+
+    if (map[nx][ny] == '#') { direction = (direction + 1) % 4; }
+    else {
+      // An obstruction placed here changes nothing before the guard first reaches it
+      if (!visited[nx * cols + ny]) {
+        visited[nx * cols + ny] = true;
+        if (map[nx][ny] == '.') { candidates.push_back({{nx, ny}, {position.first, position.second, direction}}); }
+      }
+      position = {nx, ny};
+    }
+  }
+  return candidates;
+}
+
+// For every cell and direction, the cell where the guard stops: the one just before the next '#', or -1 if the guard leaves the map.
+// Cells are row * cols + col, and an entry is (cell * 4 + direction)
+struct JumpTable {
+  int rows = 0, cols = 0;
+  vector<int> stop;
+};
+
+// Function to build the jump table of a map, sweeping every row and column once per direction
+JumpTable buildJumpTable(const vector<string>& map) {
+  JumpTable table;
+  table.rows = map.size();
+  table.cols = map[0].size();
+  const int rows = table.rows, cols = table.cols;
+  table.stop.assign(rows * cols * 4, -1);
+
+  for (int col = 0; col < cols; ++col) {
+    // Up: sweep downwards, remembering the cell below the last '#'
+    for (int row = 0, stop = -1; row < rows; ++row) {
+      if (map[row][col] == '#') { stop = (row + 1) * cols + col; }
+      else { table.stop[(row * cols + col) * 4 + 0] = stop; }
+    }
+    // Down: sweep upwards, remembering the cell above the last '#'
+    for (int row = rows - 1, stop = -1; row >= 0; --row) {
+      if (map[row][col] == '#') { stop = (row - 1) * cols + col; }
+      else { table.stop[(row * cols + col) * 4 + 2] = stop; }
+    }
+  }
+  for (int row = 0; row < rows; ++row) {
+    // Right: sweep leftwards, remembering the cell left of the last '#'
+    for (int col = cols - 1, stop = -1; col >= 0; --col) {
+      if (map[row][col] == '#') { stop = row * cols + col - 1; }
+      else { table.stop[(row * cols + col) * 4 + 1] = stop; }
+    }
+    // Left: sweep rightwards, remembering the cell right of the last '#'
+    for (int col = 0, stop = -1; col < cols; ++col) {
+      if (map[row][col] == '#') { stop = row * cols + col + 1; }
+      else { table.stop[(row * cols + col) * 4 + 3] = stop; }
+    }
+  }
+  return table;
+}
 
-  set<pair<pair<int, int>, int>> seenStates; // Track visited states (position + direction)
+// States seen by a simulation, stamped with the simulation that saw them so that no clearing is needed between runs
+struct LoopCheckScratch {
+  vector<int> seen; // (row * cols + col) * 4 + direction
+  int simulation = 0;
+};
 
-  // Place obstruction
-  map[obstruction.first][obstruction.second] = '#';
+// Simulate the guard's patrol from a given state with one extra obstruction, and check if it gets stuck in a loop.
+// The guard jumps a whole straight run per step with the jump table, so the cost is the number of turns, not the path length.
+// The obstruction is an overlay on the read-only map, so several simulations can run at the same time
+bool simulateWithLoopCheck(const JumpTable& jumps, GuardState state, const pair<int, int>& obstruction, LoopCheckScratch& scratch) {
+  const int cols = jumps.cols;
+  if (scratch.seen.empty()) { scratch.seen.assign(jumps.stop.size(), 0); }
+  const int simulation = ++scratch.simulation;
 
   while (true) {
     // Save current state
-    if (seenStates.count({position, direction})) {
-      // Loop detected
-      map[obstruction.first][obstruction.second] = '.'; // Restore map
-      return true;
-    }
-    seenStates.insert({position, direction});
+    int& seen = scratch.seen[(state.row * cols + state.col) * 4 + state.direction];
+    if (seen == simulation) { return true; } // Loop detected
+    seen = simulation;
 
-    // Calculate next position
-    int nx = position.first + DIRECTIONS[direction].first;
-    int ny = position.second + DIRECTIONS[direction].second;
+    // Distance the guard walks before the next '#', or leaving the map
+    int stop = jumps.stop[(state.row * cols + state.col) * 4 + state.direction];
+    int distance = stop == -1 ? INT_MAX : abs(stop / cols - state.row) + abs(stop % cols - state.col);
 
-    // Check if the next position is within bounds and not an obstacle
-    if (nx >= 0 && nx < rows && ny >= 0 && ny < cols && map[nx][ny] != '#') { position = {nx, ny}; } 
-    // In other case, turn right 90 degrees
-    else { direction = (direction + 1) % 4; }
+    // The obstruction cuts the run short if it lies ahead of the guard, before the '#'
+    const auto [dx, dy] = DIRECTIONS[state.direction];
+    int ahead = dx != 0 ? (obstruction.first - state.row) * dx : (obstruction.second - state.col) * dy;
+    bool inLine = dx != 0 ? obstruction.second == state.col : obstruction.first == state.row;
+    if (inLine && ahead > 0 && ahead <= distance) { distance = ahead - 1; }
+    else if (stop == -1) { return false; } // The guard leaves the map
 
-    // Check if the guard leaves the map
-    if (nx < 0 || nx >= rows || ny < 0 || ny >= cols) {
-      map[obstruction.first][obstruction.second] = '.'; // Restore map
-      return false;
-    }
+    // Walk the run, then turn right 90 degrees
+    state.row += dx * distance;
+    state.col += dy * distance;
+    state.direction = (state.direction + 1) % 4;
   }
 }
 
-// Find all possible obstruction positions that cause a loop
-vector<pair<int, int>> findLoopCausingObstructions(vector<string>& map) {
-  int rows = map.size();
-  int cols = map[0].size();
-  vector<pair<int, int>> validObstructions;
+// Candidates handed to a worker thread at a time
+const size_t CANDIDATE_BATCH_SIZE = 64;
 
-  auto [startPos, _] = findGuard(map);
+// Find all possible obstruction positions that cause a loop: only the cells of the patrol route can change it,
+// and they are checked in parallel, every worker pulling batches of candidates
+vector<pair<int, int>> findLoopCausingObstructions(const vector<string>& map, unsigned threads) {
+  auto candidates = findPatrolCandidates(map);
+  const JumpTable jumps = buildJumpTable(map);
+  vector<char> causesLoop(candidates.size(), false);
 
-  // Try every possible position for an obstruction
-  for (int i = 0; i < rows; ++i) {
-    for (int j = 0; j < cols; ++j) {
-      if (map[i][j] == '.' && make_pair(i, j) != startPos) {
-        if (simulateWithLoopCheck(map, {i, j})) {
-          validObstructions.push_back({i, j});
+  atomic<size_t> nextCandidate(0);
+  vector<thread> workers;
+  for (unsigned worker = 0; worker < threads; ++worker) {
+    workers.emplace_back([&]() {
+      LoopCheckScratch scratch;
+      for (size_t begin; (begin = nextCandidate.fetch_add(CANDIDATE_BATCH_SIZE)) < candidates.size();) {
+        size_t end = min(candidates.size(), begin + CANDIDATE_BATCH_SIZE);
+        for (size_t i = begin; i < end; ++i) {
+          causesLoop[i] = simulateWithLoopCheck(jumps, candidates[i].second, candidates[i].first, scratch);
         }
       }
-    }
+    });
   }
+  for (thread& worker : workers) { worker.join(); }
 
+  // Report the positions in row-major order
+  vector<pair<int, int>> validObstructions;
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    if (causesLoop[i]) { validObstructions.push_back(candidates[i].first); }
+  }
+  sort(validObstructions.begin(), validObstructions.end());
   return validObstructions;
 }
 
 int main(int argc, char* argv[]) {
   // Check if the input file is provided
   if (argc < 2) {
-    cerr << "Usage: " << argv[0] << " <input_file> [-trace]" << endl;
+    cerr << "Usage: " << argv[0] << " <input_file> [-trace] [-threads <n>]" << endl;
     return EXIT_FAILURE;
   }
 
-  // Check if the -trace option is provided
+  // Check if the -trace and -threads options are provided
   bool trace = false;
-  if (argc > 2 && string(argv[2]) == "-trace") { trace = true; }
+  unsigned threads = max(1u, thread::hardware_concurrency());
+  for (int i = 2; i < argc; ++i) {
+    string option = argv[i];
+    if (option == "-trace") { trace = true; }
+    else if (i + 1 < argc && option == "-threads") { threads = max(1, atoi(argv[++i])); }
+    else {
+      cerr << "Error: Unknown option " << option << endl;
+      return EXIT_FAILURE;
+    }
+  }
 
   ifstream inputFile(argv[1]);
   if (!inputFile) {
@@ -166,7 +267,7 @@ int main(int argc, char* argv[]) {
 
   // Phase 2: Find all possible obstruction positions that cause a loop
   if (map_obstructions.size() > 100) { cout << "Warning: This phase may take a while to complete." << endl; }
-  vector<pair<int, int>> obstructions = findLoopCausingObstructions(map_obstructions);
+  vector<pair<int, int>> obstructions = findLoopCausingObstructions(map_obstructions, threads);
 
   // Output the number of valid obstruction positions, and the positions if -trace is provided
   cout << "Number of valid obstruction positions: " << obstructions.size() << endl;